@@ -0,0 +1,342 @@
+// Benchmarks suffix array construction and search throughput on reproducible,
+// synthetic corpora. Every measurement is printed as one line of JSON so
+// results can be collected and compared between versions.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../source/suffix_array.h"
+
+#define DEFAULT_SIZE 1000000
+#define DEFAULT_QUERIES 1000000
+#define DEFAULT_SEED 1
+#define QUADRATIC_LIMIT 20000
+#define VOCABULARY_SIZE 64
+
+// The kinds of synthetic text that can be generated.
+typedef enum corpus_kind {
+    CORPUS_UNIFORM,
+    CORPUS_DNA,
+    CORPUS_REPETITIVE,
+    CORPUS_NATURAL,
+    CORPUS_KINDS
+} corpus_kind;
+
+// The structures that can speed up searches, one of which is measured at a time.
+typedef enum search_setup {
+    SEARCH_PLAIN,
+    SEARCH_LCP,
+    SEARCH_PREFIX_TABLE,
+    SEARCH_LAYOUT,
+    SEARCH_SETUPS
+} search_setup;
+
+// Settings chosen with command line options.
+typedef struct benchmark_options {
+    text_position size;
+    long queries;
+    unsigned long long seed;
+    int threads;
+} benchmark_options;
+
+static const char* corpus_names[CORPUS_KINDS] = {"uniform", "dna", "repetitive", "natural"};
+static const char* method_names[] = {"induced", "radix", "counting", "parallel"};
+static const char* setup_names[SEARCH_SETUPS] = {"plain", "lcp", "prefix_table", "layout"};
+static const int pattern_lengths[] = {4, 8, 16, 32};
+
+// Generate the next number from a seeded xorshift generator, so every run
+// with the same seed produces the same corpus on every platform.
+static unsigned long long next_random(unsigned long long* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 2685821657736338717ULL;
+}
+
+// Generate a corpus of the requested kind and size.
+char* generate_corpus(corpus_kind kind, text_position size, unsigned long long seed) {
+    int word;
+    int rank;
+    int length;
+    char* corpus;
+    text_position position;
+    unsigned long long state;
+    char vocabulary[VOCABULARY_SIZE][12];
+
+    if ((corpus = malloc(sizeof(char) * (size + 1))) == NULL) {
+        return NULL;
+    }
+    state = seed * 0x9E3779B97F4A7C15ULL + kind + 1;
+
+    if (kind == CORPUS_UNIFORM) {
+        for (position = 0; position < size; position++) {
+            corpus[position] = 'a' + next_random(&state) % 26;
+        }
+    }
+    else if (kind == CORPUS_DNA) {
+        for (position = 0; position < size; position++) {
+            corpus[position] = "acgt"[next_random(&state) % 4];
+        }
+    }
+
+    // A short motif repeated end to end, with a rare point mutation. Almost
+    // every suffix shares a long prefix with many others.
+    else if (kind == CORPUS_REPETITIVE) {
+        for (position = 0; position < size; position++) {
+            corpus[position] = "abracadabra"[position % 11];
+            if (next_random(&state) % 100000 == 0) {
+                corpus[position] = 'z';
+            }
+        }
+    }
+
+    // Words drawn from a fixed vocabulary with a Zipf-like skew, run together
+    // because the driver keeps only alphabetic characters.
+    else {
+        for (word = 0; word < VOCABULARY_SIZE; word++) {
+            length = 2 + next_random(&state) % 9;
+            for (rank = 0; rank < length; rank++) {
+                vocabulary[word][rank] = 'a' + next_random(&state) % 26;
+            }
+            vocabulary[word][length] = '\0';
+        }
+        position = 0;
+        while (position < size) {
+            rank = VOCABULARY_SIZE;
+            while (rank > 1 && next_random(&state) % 2 == 0) {
+                rank /= 2;
+            }
+            word = next_random(&state) % rank;
+            for (length = 0; vocabulary[word][length] != '\0' && position < size; length++) {
+                corpus[position++] = vocabulary[word][length];
+            }
+        }
+    }
+
+    corpus[size] = '\0';
+
+    return corpus;
+}
+
+// Measure the seconds elapsed since a starting time on a wall clock.
+static double seconds_since(struct timespec* start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Determine the peak resident memory of this process, in kilobytes.
+static long peak_memory(void) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_maxrss;
+}
+
+// Time the construction of a suffix array with one method and report it.
+static void benchmark_construction(
+    corpus_kind kind,
+    char* corpus,
+    sort_method method,
+    benchmark_options* options
+) {
+    double seconds;
+    struct timespec start;
+    suffix_array* array;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    array = new_suffix_array_using(corpus, method, options->threads);
+    seconds = seconds_since(&start);
+
+    printf(
+        "{\"benchmark\": \"construction\", \"corpus\": \"%s\", \"size\": " TEXT_POSITION_FORMAT
+        ", \"seed\": %llu, \"method\": \"%s\", \"threads\": %d, \"success\": %s"
+        ", \"seconds\": %.6f, \"characters_per_second\": %.0f, \"peak_rss_kb\": %ld}\n",
+        corpus_names[kind],
+        options->size,
+        options->seed,
+        method_names[method],
+        (method != SORT_PARALLEL) ? 1 : (options->threads < 1) ? default_thread_count() : options->threads,
+        (array != NULL) ? "true" : "false",
+        seconds,
+        options->size / seconds,
+        peak_memory()
+    );
+    destroy_suffix_array(array);
+}
+
+// Time a stream of searches for patterns sampled from the corpus, so that
+// every query hits, and report the throughput.
+static void benchmark_queries(
+    corpus_kind kind,
+    suffix_array* array,
+    int pattern_length,
+    search_setup setup,
+    benchmark_options* options
+) {
+    long query;
+    long found;
+    double seconds;
+    char* patterns;
+    struct timespec start;
+    suffix_range range;
+    unsigned long long state;
+    text_position position;
+
+    if (pattern_length > array->string_length) {
+        return;
+    }
+
+    // Sample all the patterns up front so that only searching is timed.
+    if ((patterns = malloc(sizeof(char) * (pattern_length + 1) * options->queries)) == NULL) {
+        return;
+    }
+    state = options->seed + pattern_length;
+    for (query = 0; query < options->queries; query++) {
+        position = next_random(&state) % (array->string_length - pattern_length + 1);
+        memcpy(patterns + query * (pattern_length + 1), array->string + position, pattern_length);
+        patterns[query * (pattern_length + 1) + pattern_length] = '\0';
+    }
+
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (query = 0; query < options->queries; query++) {
+        search_range(array, patterns + query * (pattern_length + 1), &range);
+        found += (range.high > range.low);
+    }
+    seconds = seconds_since(&start);
+
+    printf(
+        "{\"benchmark\": \"queries\", \"corpus\": \"%s\", \"size\": " TEXT_POSITION_FORMAT
+        ", \"seed\": %llu, \"pattern_length\": %d, \"search\": \"%s\", \"queries\": %ld, \"found\": %ld"
+        ", \"seconds\": %.6f, \"queries_per_second\": %.0f, \"peak_rss_kb\": %ld}\n",
+        corpus_names[kind],
+        options->size,
+        options->seed,
+        pattern_length,
+        setup_names[setup],
+        options->queries,
+        found,
+        seconds,
+        options->queries / seconds,
+        peak_memory()
+    );
+    free(patterns);
+}
+
+// Build the structure that a search setup measures.
+static flag prepare_search(suffix_array* array, search_setup setup) {
+    if (setup == SEARCH_LCP) {
+        return build_lcp_array(array);
+    }
+    else if (setup == SEARCH_PREFIX_TABLE) {
+        return build_prefix_table(array, 0);
+    }
+    else if (setup == SEARCH_LAYOUT) {
+        return build_search_layout(array, 0);
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Run one measurement in a child process, so that its peak memory isn't
+// inflated by whatever ran before it.
+static void run_isolated(corpus_kind kind, int method, benchmark_options* options) {
+    int length;
+    char* corpus;
+    pid_t child;
+    search_setup setup;
+    suffix_array* array;
+
+    fflush(stdout);
+    if ((child = fork()) != 0) {
+        if (child > 0) {
+            waitpid(child, NULL, 0);
+        }
+
+        return;
+    }
+
+    if ((corpus = generate_corpus(kind, options->size, options->seed)) == NULL) {
+        _exit(1);
+    }
+
+    // A negative method stands for the query benchmarks, where -1 - method
+    // is the search setup to measure.
+    if (method >= 0) {
+        benchmark_construction(kind, corpus, method, options);
+    }
+    else if ((array = new_suffix_array(corpus)) != NULL) {
+        setup = -1 - method;
+        if (prepare_search(array, setup) == FLAG_SUCCESS) {
+            for (length = 0; length < (int) (sizeof(pattern_lengths) / sizeof(int)); length++) {
+                benchmark_queries(kind, array, pattern_lengths[length], setup, options);
+            }
+        }
+        destroy_suffix_array(array);
+    }
+
+    free(corpus);
+    fflush(stdout);
+    _exit(0);
+}
+
+// Main entry point of the benchmark.
+int main(int argument_count, char** arguments) {
+    int kind;
+    int setup;
+    int method;
+    int argument;
+    benchmark_options options;
+
+    options.size = DEFAULT_SIZE;
+    options.queries = DEFAULT_QUERIES;
+    options.seed = DEFAULT_SEED;
+    options.threads = 0;
+    for (argument = 1; argument + 1 < argument_count; argument += 2) {
+        if (strcmp(arguments[argument], "--size") == 0) {
+            options.size = atoll(arguments[argument + 1]);
+        }
+        else if (strcmp(arguments[argument], "--queries") == 0) {
+            options.queries = atol(arguments[argument + 1]);
+        }
+        else if (strcmp(arguments[argument], "--seed") == 0) {
+            options.seed = strtoull(arguments[argument + 1], NULL, 10);
+        }
+        else if (strcmp(arguments[argument], "--threads") == 0) {
+            options.threads = atoi(arguments[argument + 1]);
+        }
+        else {
+            break;
+        }
+    }
+    if (argument < argument_count || options.size < 1 || options.queries < 1) {
+        fprintf(stderr, "Usage: %s [--size <n>] [--queries <n>] [--seed <n>] [--threads <n>]\n", arguments[0]);
+
+        return -1;
+    }
+
+    // The radix sorts are quadratic, so they only run on small corpora.
+    for (kind = 0; kind < CORPUS_KINDS; kind++) {
+        for (method = SORT_INDUCED; method <= SORT_PARALLEL; method++) {
+            if ((method == SORT_RADIX || method == SORT_COUNTING) && options.size > QUADRATIC_LIMIT) {
+                continue;
+            }
+            run_isolated(kind, method, &options);
+        }
+        for (setup = SEARCH_PLAIN; setup < SEARCH_SETUPS; setup++) {
+            run_isolated(kind, -1 - setup, &options);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+// Provides an index over a growing text. New text is indexed on its own as a
+// small tier, and tiers are merged once they grow comparable in size, so each
+// character is only resorted a logarithmic number of times. Searches ask every
+// tier and then check the few places where a match could cross between tiers.
+// The text is only stored once, in the index's string, which every tier's
+// suffix array borrows its characters from.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "suffix_array.h"
+
+// Create an empty appendable index whose tiers will be sorted with the chosen
+// method and thread count.
+appendable_index* new_appendable_index(sort_method method, int threads) {
+    appendable_index* index;
+
+    if ((index = calloc(1, sizeof(appendable_index))) == NULL) {
+        return NULL;
+    }
+    if ((index->string = malloc(sizeof(char))) == NULL) {
+        free(index);
+
+        return NULL;
+    }
+    index->string[0] = '\0';
+    index->capacity = 1;
+    index->method = method;
+    index->threads = threads;
+
+    return index;
+}
+
+// Get the number of characters covered by a tier.
+static text_position tier_length(index_tier* tier) {
+    return tier->array->string_length;
+}
+
+// Replace the last tier with one built over its own text and the text of the
+// tier before it.
+static flag merge_last_tiers(appendable_index* index) {
+    index_tier* first;
+    index_tier* second;
+    suffix_array* merged;
+
+    first = &index->tiers[index->tier_count - 2];
+    second = &index->tiers[index->tier_count - 1];
+    merged = new_borrowed_suffix_array(
+        index->string + first->start,
+        tier_length(first) + tier_length(second),
+        index->method,
+        index->threads
+    );
+    if (merged == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    destroy_suffix_array(first->array);
+    destroy_suffix_array(second->array);
+    first->array = merged;
+    index->tier_count--;
+
+    return FLAG_SUCCESS;
+}
+
+// Append text to the end of an appendable index. The text becomes a tier of
+// its own, which is then merged with the tiers before it for as long as they
+// are less than twice its size. Tier sizes therefore at least double from the
+// newest tier to the oldest, so there are only ever a logarithmic number of
+// them, and appending costs time in proportion to the new text, amortized.
+// If a merge fails, the new text is still searchable in a tier of its own.
+flag append_text(appendable_index* index, char* text) {
+    int tier;
+    size_t length;
+    size_t capacity;
+    char* resized;
+    suffix_array* array;
+
+    if (index == NULL || text == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    length = strlen(text);
+    if (length == 0) {
+        return FLAG_SUCCESS;
+    }
+    if (
+        length >= (size_t) TEXT_POSITION_MAX - 1 - index->string_length
+        || index->tier_count == APPEND_MAX_TIERS
+    ) {
+        return FLAG_FAILURE;
+    }
+
+    // Grow the string geometrically, so repeated small appends stay cheap.
+    // Every tier borrows its text from the string, so they all follow it if
+    // it moves.
+    if (index->string_length + length + 1 > index->capacity) {
+        capacity = 2 * index->capacity + length + 1;
+        if ((resized = realloc(index->string, sizeof(char) * capacity)) == NULL) {
+            return FLAG_FAILURE;
+        }
+        index->string = resized;
+        index->capacity = capacity;
+        for (tier = 0; tier < index->tier_count; tier++) {
+            index->tiers[tier].array->string = index->string + index->tiers[tier].start;
+        }
+    }
+
+    // The new text is sorted where it lands at the end of the string. If
+    // that fails, the string is cut back, so the index is just as it was.
+    memcpy(index->string + index->string_length, text, length + 1);
+    array = new_borrowed_suffix_array(
+        index->string + index->string_length,
+        length,
+        index->method,
+        index->threads
+    );
+    if (array == NULL) {
+        index->string[index->string_length] = '\0';
+
+        return FLAG_FAILURE;
+    }
+
+    index->tiers[index->tier_count].array = array;
+    index->tiers[index->tier_count].start = index->string_length;
+    index->tier_count++;
+    index->string_length += length;
+
+    while (
+        index->tier_count > 1
+        && tier_length(&index->tiers[index->tier_count - 2])
+        < 2 * tier_length(&index->tiers[index->tier_count - 1])
+    ) {
+        if (merge_last_tiers(index) == FLAG_FAILURE) {
+            return FLAG_FAILURE;
+        }
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Merge every tier of an appendable index into one, so searches only have to
+// ask a single suffix array.
+flag compact_appendable_index(appendable_index* index) {
+
+    if (index == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    while (index->tier_count > 1) {
+        if (merge_last_tiers(index) == FLAG_FAILURE) {
+            return FLAG_FAILURE;
+        }
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Visit every position where a pattern appears in an appendable index, saving
+// them in positions if it isn't NULL. Matches that lie inside a tier come from
+// its suffix array. A match that crosses into later tiers is checked directly,
+// and only at the first boundary it crosses, so it is never found twice.
+// Returns the number of matches.
+static text_position visit_occurrences(appendable_index* index, char* pattern, text_position* positions) {
+    int tier;
+    text_position count;
+    text_position start;
+    text_position boundary;
+    text_position position;
+    text_position pattern_length;
+    suffix_range range;
+
+    pattern_length = strlen(pattern);
+    count = 0;
+    for (tier = 0; tier < index->tier_count; tier++) {
+        if (search_range(index->tiers[tier].array, pattern, &range) == FLAG_FAILURE) {
+            return FLAG_FAILURE;
+        }
+        if (positions == NULL) {
+            count += range.high - range.low;
+        }
+        else {
+            while ((position = next_occurrence(index->tiers[tier].array, &range)) != FLAG_FAILURE) {
+                positions[count++] = index->tiers[tier].start + position;
+            }
+        }
+
+        if (tier + 1 == index->tier_count) {
+            break;
+        }
+        boundary = index->tiers[tier + 1].start;
+        start = boundary - pattern_length + 1;
+        if (start < index->tiers[tier].start) {
+            start = index->tiers[tier].start;
+        }
+        for (; start < boundary && start + pattern_length <= index->string_length; start++) {
+            if (memcmp(index->string + start, pattern, pattern_length) == 0) {
+                if (positions != NULL) {
+                    positions[count] = start;
+                }
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+// Count the number of times a pattern appears in an appendable index.
+text_position appendable_count_occurrences(appendable_index* index, char* pattern) {
+
+    if (index == NULL || pattern == NULL || pattern[0] == '\0') {
+        return FLAG_FAILURE;
+    }
+
+    return visit_occurrences(index, pattern, NULL);
+}
+
+// Compare two positions.
+static int compare_positions(const void* first, const void* second) {
+    text_position left;
+    text_position right;
+
+    left = *(const text_position*) first;
+    right = *(const text_position*) second;
+
+    return (left > right) - (left < right);
+}
+
+// Find every position where a pattern appears in an appendable index. The
+// positions are saved in a new array, in string order, which the caller must
+// free. Returns the number of positions.
+text_position appendable_find_occurrences(appendable_index* index, char* pattern, text_position** positions) {
+    text_position count;
+
+    if (positions == NULL) {
+        return FLAG_FAILURE;
+    }
+    *positions = NULL;
+    if ((count = appendable_count_occurrences(index, pattern)) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    if ((*positions = malloc(sizeof(text_position) * count)) == NULL) {
+        return FLAG_FAILURE;
+    }
+    visit_occurrences(index, pattern, *positions);
+    qsort(*positions, count, sizeof(text_position), compare_positions);
+
+    return count;
+}
+
+// Destroy an appendable index and all of its tiers.
+void destroy_appendable_index(appendable_index* index) {
+    int tier;
+
+    if (index == NULL) {
+        return;
+    }
+
+    for (tier = 0; tier < index->tier_count; tier++) {
+        destroy_suffix_array(index->tiers[tier].array);
+    }
+    free(index->string);
+    free(index);
+}
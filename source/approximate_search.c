@@ -0,0 +1,303 @@
+// Finds approximate occurrences of a pattern by walking the suffix array as
+// if it were a trie. The suffixes that share a prefix form a range of sorted
+// suffixes, and the ranges for each next character are found by binary search
+// within it. A walk backs out of any range whose prefix is already too far
+// from the pattern, so only a small part of the index is ever visited.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "suffix_array.h"
+
+// The state of a walk over the suffix array. Each range that was found to
+// match is saved along with its distance, to be expanded into hits once the
+// walk is over. For edit distance, rows holds one row of the distance table
+// for every depth of the walk.
+typedef struct approximate_walk {
+    suffix_array* array;
+    char* pattern;
+    text_position pattern_length;
+    int max_distance;
+    text_position* rows;
+    suffix_range* ranges;
+    int* distances;
+    text_position range_count;
+    text_position range_capacity;
+    text_position hit_count;
+} approximate_walk;
+
+// Get the character at a depth of the sorted suffix at an index, or -1 if
+// the suffix is too short to have one.
+static int character_at(suffix_array* array, text_position index, text_position depth) {
+    text_position position;
+
+    position = suffix_at(array, index);
+    if (depth >= array->string_length - position) {
+        return -1;
+    }
+
+    return (unsigned char) array->string[position + depth];
+}
+
+// Find the first suffix in a range whose character at a depth comes after
+// the given one. Every suffix in the range must share its first depth
+// characters, so their characters at the depth are in sorted order.
+static text_position character_end(
+    suffix_array* array,
+    text_position low,
+    text_position high,
+    text_position depth,
+    int character
+) {
+    text_position mid;
+
+    while (low < high) {
+        STATS_SEARCH_ADD(probes, 1);
+        mid = low + (high - low) / 2;
+        if (character_at(array, mid, depth) <= character) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+// Save a range of suffixes that match at a distance.
+static flag save_range(approximate_walk* walk, suffix_range* range, int distance) {
+    text_position capacity;
+    int* distances;
+    suffix_range* ranges;
+
+    if (walk->range_count == walk->range_capacity) {
+        capacity = 2 * walk->range_capacity + 16;
+        if ((ranges = realloc(walk->ranges, sizeof(suffix_range) * capacity)) == NULL) {
+            return FLAG_FAILURE;
+        }
+        walk->ranges = ranges;
+        if ((distances = realloc(walk->distances, sizeof(int) * capacity)) == NULL) {
+            return FLAG_FAILURE;
+        }
+        walk->distances = distances;
+        walk->range_capacity = capacity;
+    }
+    walk->ranges[walk->range_count] = *range;
+    walk->distances[walk->range_count] = distance;
+    walk->range_count++;
+    walk->hit_count += range->high - range->low;
+
+    return FLAG_SUCCESS;
+}
+
+// Walk the suffixes in a range, which all share a prefix of some depth that
+// is a distance away from the same prefix of the pattern, counting each
+// differing character as a mismatch. Once there are no mismatches left to
+// spend, the rest of the pattern must match exactly, so an ordinary search
+// of the range finishes the walk.
+static flag walk_mismatches(approximate_walk* walk, suffix_range* range, text_position depth, int distance) {
+    int character;
+    text_position start;
+    suffix_range child;
+
+    if (distance == walk->max_distance || depth == walk->pattern_length) {
+        child = *range;
+        narrow_range(walk->array, walk->pattern, depth, &child);
+
+        return (child.low == child.high) ? FLAG_SUCCESS : save_range(walk, &child, distance);
+    }
+
+    // Suffixes that end at this depth sort first, and are too short to
+    // match. The rest are split up by their next character.
+    start = character_end(walk->array, range->low, range->high, depth, -1);
+    while (start < range->high) {
+        character = character_at(walk->array, start, depth);
+        child.low = start;
+        child.high = character_end(walk->array, start, range->high, depth, character);
+        if (
+            walk_mismatches(
+                walk,
+                &child,
+                depth + 1,
+                distance + (character != (unsigned char) walk->pattern[depth])
+            ) == FLAG_FAILURE
+        ) {
+            return FLAG_FAILURE;
+        }
+        start = child.high;
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Walk the suffixes in a range, which all share a prefix of some depth, by
+// edit distance. Entry j of the row for a depth is the edit distance between
+// the shared prefix and the first j characters of the pattern, so the last
+// entry says how well the prefix matches the whole pattern. Since no entry
+// ever shrinks as the prefix grows, a range is abandoned as soon as every
+// entry is over the limit.
+static flag walk_edits(approximate_walk* walk, suffix_range* range, text_position depth) {
+    int character;
+    text_position column;
+    text_position start;
+    text_position smallest;
+    text_position* row;
+    text_position* next;
+    suffix_range child;
+
+    row = walk->rows + depth * (walk->pattern_length + 1);
+    next = row + walk->pattern_length + 1;
+    start = character_end(walk->array, range->low, range->high, depth, -1);
+    while (start < range->high) {
+        character = character_at(walk->array, start, depth);
+        child.low = start;
+        child.high = character_end(walk->array, start, range->high, depth, character);
+        start = child.high;
+
+        // Extend the table by the child's character.
+        next[0] = depth + 1;
+        smallest = next[0];
+        for (column = 1; column <= walk->pattern_length; column++) {
+            next[column] = row[column - 1] + (character != (unsigned char) walk->pattern[column - 1]);
+            if (row[column] + 1 < next[column]) {
+                next[column] = row[column] + 1;
+            }
+            if (next[column - 1] + 1 < next[column]) {
+                next[column] = next[column - 1] + 1;
+            }
+            if (next[column] < smallest) {
+                smallest = next[column];
+            }
+        }
+        if (smallest > walk->max_distance) {
+            continue;
+        }
+
+        // A longer prefix might match the pattern more closely, so the walk
+        // goes on even after a match.
+        if (
+            next[walk->pattern_length] <= walk->max_distance
+            && save_range(walk, &child, next[walk->pattern_length]) == FLAG_FAILURE
+        ) {
+            return FLAG_FAILURE;
+        }
+        if (walk_edits(walk, &child, depth + 1) == FLAG_FAILURE) {
+            return FLAG_FAILURE;
+        }
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Compare two hits by position, then by distance.
+static int compare_hits(const void* first, const void* second) {
+    const approximate_hit* left;
+    const approximate_hit* right;
+
+    left = (const approximate_hit*) first;
+    right = (const approximate_hit*) second;
+    if (left->position != right->position) {
+        return (left->position > right->position) - (left->position < right->position);
+    }
+
+    return (left->distance > right->distance) - (left->distance < right->distance);
+}
+
+// Find every position where a substring within a distance of a pattern
+// starts. By Hamming distance, the substring is as long as the pattern and
+// each differing character counts once. By edit distance, each inserted,
+// deleted, or substituted character counts once, and a position is reported
+// with the smallest distance of any substring starting there. The distance
+// must be less than the length of the pattern, or every position would match.
+// The hits are saved in a new array, in string order, which the caller must
+// free. Returns the number of hits.
+text_position approximate_search(
+    suffix_array* array,
+    char* pattern,
+    int max_distance,
+    distance_measure measure,
+    approximate_hit** hits
+) {
+    flag result;
+    text_position hit;
+    text_position kept;
+    text_position index;
+    text_position entry;
+    suffix_range range;
+    approximate_walk walk;
+    unsigned long long start_time;
+
+    if (hits == NULL) {
+        return FLAG_FAILURE;
+    }
+    *hits = NULL;
+    if (array == NULL || pattern == NULL || max_distance < 0 || (size_t) max_distance >= strlen(pattern)) {
+        return FLAG_FAILURE;
+    }
+
+    start_time = STATS_TIME();
+    memset(&walk, 0, sizeof(approximate_walk));
+    walk.array = array;
+    walk.pattern = pattern;
+    walk.pattern_length = strlen(pattern);
+    walk.max_distance = max_distance;
+    range.low = 0;
+    range.high = array->string_length;
+    if (measure == DISTANCE_HAMMING) {
+        result = walk_mismatches(&walk, &range, 0, 0);
+    }
+    else {
+
+        // No prefix can be more than max_distance characters longer than
+        // the pattern and still be close enough to it.
+        walk.rows = malloc(
+            sizeof(text_position) * (walk.pattern_length + max_distance + 2) * (walk.pattern_length + 1)
+        );
+        if (walk.rows == NULL) {
+            return FLAG_FAILURE;
+        }
+        for (entry = 0; entry <= walk.pattern_length; entry++) {
+            walk.rows[entry] = entry;
+        }
+        result = walk_edits(&walk, &range, 0);
+        free(walk.rows);
+    }
+    if (result == FLAG_FAILURE || walk.hit_count == 0) {
+        free(walk.ranges);
+        free(walk.distances);
+        STATS_SEARCH(start_time);
+
+        return (result == FLAG_FAILURE) ? FLAG_FAILURE : 0;
+    }
+
+    // Turn the ranges into hits. By edit distance, a position may have been
+    // found at several distances, so only its closest hit is kept.
+    if ((*hits = malloc(sizeof(approximate_hit) * walk.hit_count)) == NULL) {
+        free(walk.ranges);
+        free(walk.distances);
+
+        return FLAG_FAILURE;
+    }
+    hit = 0;
+    for (entry = 0; entry < walk.range_count; entry++) {
+        for (index = walk.ranges[entry].low; index < walk.ranges[entry].high; index++) {
+            (*hits)[hit].position = suffix_at(array, index);
+            (*hits)[hit].distance = walk.distances[entry];
+            hit++;
+        }
+    }
+    free(walk.ranges);
+    free(walk.distances);
+    qsort(*hits, hit, sizeof(approximate_hit), compare_hits);
+    kept = 1;
+    for (entry = 1; entry < hit; entry++) {
+        if ((*hits)[entry].position != (*hits)[kept - 1].position) {
+            (*hits)[kept++] = (*hits)[entry];
+        }
+    }
+    STATS_SEARCH(start_time);
+
+    return kept;
+}
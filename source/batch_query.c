@@ -0,0 +1,292 @@
+// Answers large batches of search patterns on a pool of threads that share
+// one read-only suffix array.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "suffix_array.h"
+
+// The shared state of the threads answering a batch. Queries are answered
+// with the FM-index if there is one, and the suffix array otherwise.
+typedef struct batch_worker_state {
+    suffix_array* array;
+    fm_index* index;
+    query_batch* batch;
+    int next_query;
+    pthread_mutex_t lock;
+} batch_worker_state;
+
+// Compare two queries by their patterns.
+static int compare_queries(const void* first, const void* second) {
+    return strcmp(((const batch_query*) first)->pattern, ((const batch_query*) second)->pattern);
+}
+
+// Read a batch of patterns, one per line, from a stream. Empty lines are skipped.
+query_batch* read_query_batch(FILE* stream) {
+    char* line;
+    char* buffer;
+    char* resized;
+    size_t length;
+    size_t capacity;
+    size_t bytes_read;
+    int query;
+    int line_count;
+    query_batch* batch;
+
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    // Slurp the whole stream in large blocks. It may be a pipe, so its size
+    // isn't known up front.
+    length = 0;
+    capacity = BATCH_READ_SIZE;
+    if ((buffer = malloc(capacity + 1)) == NULL) {
+        return NULL;
+    }
+    while ((bytes_read = fread(buffer + length, 1, capacity - length, stream)) > 0) {
+        length += bytes_read;
+        if (length == capacity) {
+            capacity *= 2;
+            if ((resized = realloc(buffer, capacity + 1)) == NULL) {
+                free(buffer);
+
+                return NULL;
+            }
+            buffer = resized;
+        }
+    }
+    buffer[length] = '\0';
+
+    // Split the buffer into lines in place, counting them as we go.
+    line_count = 0;
+    for (line = buffer; line < buffer + length; line++) {
+        if (*line == '\n' || *line == '\r') {
+            *line = '\0';
+        }
+        else if (line == buffer || *(line - 1) == '\0') {
+            line_count++;
+        }
+    }
+
+    if ((batch = calloc(1, sizeof(query_batch))) == NULL) {
+        free(buffer);
+
+        return NULL;
+    }
+    batch->buffer = buffer;
+    if (
+        (batch->patterns = malloc(sizeof(char*) * (line_count + 1))) == NULL
+        || (batch->order = malloc(sizeof(batch_query) * (line_count + 1))) == NULL
+        || (batch->results = malloc(sizeof(suffix_range) * (line_count + 1))) == NULL
+    ) {
+        destroy_query_batch(batch);
+
+        return NULL;
+    }
+
+    // Save the start of every non-empty line as a pattern.
+    query = 0;
+    for (line = buffer; line < buffer + length; line++) {
+        if (*line != '\0' && (line == buffer || *(line - 1) == '\0')) {
+            batch->patterns[query] = line;
+            batch->order[query].pattern = line;
+            batch->order[query].index = query;
+            query++;
+        }
+    }
+    batch->query_count = query;
+
+    return batch;
+}
+
+// Answer queries from the shared batch until none are left. Queries are
+// claimed in chunks of neighboring patterns in sorted order, so consecutive
+// searches walk the same regions of the suffix array while they're still cached.
+static void* answer_queries(void* argument) {
+    int query;
+    int index;
+    int last_query;
+    query_batch* batch;
+    suffix_range* result;
+    flag found;
+    batch_worker_state* state;
+
+    state = (batch_worker_state*) argument;
+    batch = state->batch;
+    while (1) {
+        pthread_mutex_lock(&state->lock);
+        query = state->next_query;
+        state->next_query += BATCH_CHUNK_SIZE;
+        pthread_mutex_unlock(&state->lock);
+
+        if (query >= batch->query_count) {
+            break;
+        }
+
+        // Results go back to the slot of the pattern's original position.
+        last_query = query + BATCH_CHUNK_SIZE;
+        if (last_query > batch->query_count) {
+            last_query = batch->query_count;
+        }
+        for (; query < last_query; query++) {
+            index = batch->order[query].index;
+            result = &batch->results[index];
+            if (state->index != NULL) {
+                found = fm_search_range(state->index, batch->patterns[index], result);
+            }
+            else {
+                found = search_range(state->array, batch->patterns[index], result);
+            }
+            if (found == FLAG_FAILURE) {
+                result->low = 0;
+                result->high = 0;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Answer every query in a batch on a pool of threads. A thread count below 1
+// means one thread per online processor.
+static flag answer_batch(batch_worker_state* state, int threads) {
+    int thread;
+    int started;
+    pthread_t* workers;
+
+    if (threads < 1) {
+        threads = default_thread_count();
+    }
+
+    // Sort the patterns so neighboring queries probe neighboring suffixes.
+    qsort(state->batch->order, state->batch->query_count, sizeof(batch_query), compare_queries);
+
+    state->next_query = 0;
+    if (pthread_mutex_init(&state->lock, NULL) != 0) {
+        return FLAG_FAILURE;
+    }
+    if ((workers = malloc(sizeof(pthread_t) * threads)) == NULL) {
+        pthread_mutex_destroy(&state->lock);
+
+        return FLAG_FAILURE;
+    }
+
+    // If a thread can't be started, the ones that did start will simply
+    // pick up its share of the work.
+    started = 0;
+    for (thread = 0; thread < threads; thread++) {
+        if (pthread_create(&workers[started], NULL, answer_queries, state) == 0) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        answer_queries(state);
+    }
+    for (thread = 0; thread < started; thread++) {
+        pthread_join(workers[thread], NULL);
+    }
+
+    free(workers);
+    pthread_mutex_destroy(&state->lock);
+
+    return FLAG_SUCCESS;
+}
+
+// Answer every query in a batch with a suffix array, using the given number
+// of threads. A thread count below 1 means one thread per online processor.
+flag run_query_batch(suffix_array* array, query_batch* batch, int threads) {
+    batch_worker_state state;
+
+    if (array == NULL || batch == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    state.array = array;
+    state.index = NULL;
+    state.batch = batch;
+
+    return answer_batch(&state, threads);
+}
+
+// Answer every query in a batch with an FM-index, using the given number
+// of threads. A thread count below 1 means one thread per online processor.
+flag run_fm_query_batch(fm_index* index, query_batch* batch, int threads) {
+    batch_worker_state state;
+
+    if (index == NULL || batch == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    state.array = NULL;
+    state.index = index;
+    state.batch = batch;
+
+    return answer_batch(&state, threads);
+}
+
+// Print the answer to every query in a batch, in the order the patterns were read.
+// Each line holds the pattern, its number of occurrences, and the position of
+// its first occurrence in sorted order, or -1 if it wasn't found.
+static void print_batch(suffix_array* array, fm_index* index, query_batch* batch) {
+    int query;
+    suffix_range* result;
+
+    for (query = 0; query < batch->query_count; query++) {
+        result = &batch->results[query];
+        printf(
+            "%s\t" TEXT_POSITION_FORMAT "\t" TEXT_POSITION_FORMAT "\n",
+            batch->patterns[query],
+            result->high - result->low,
+            (result->high <= result->low)
+                ? -1
+                : (index != NULL) ? fm_locate(index, result->low) : suffix_at(array, result->low)
+        );
+    }
+}
+
+// Print the answers to a batch that was run on a suffix array.
+void print_query_batch(suffix_array* array, query_batch* batch) {
+
+    if (array == NULL || batch == NULL) {
+        return;
+    }
+
+    print_batch(array, NULL, batch);
+}
+
+// Print the answers to a batch that was run on an FM-index.
+void print_fm_query_batch(fm_index* index, query_batch* batch) {
+
+    if (index == NULL || batch == NULL) {
+        return;
+    }
+
+    print_batch(NULL, index, batch);
+}
+
+// Determine how many threads to use when the caller doesn't say.
+int default_thread_count(void) {
+    long processors;
+
+    processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (processors < 1) ? 1 : (int) processors;
+}
+
+// Destroy a batch of queries.
+void destroy_query_batch(query_batch* batch) {
+
+    if (batch == NULL) {
+        return;
+    }
+
+    free(batch->results);
+    free(batch->order);
+    free(batch->patterns);
+    free(batch->buffer);
+    free(batch);
+}
@@ -0,0 +1,197 @@
+// Provides a generalized suffix array over a collection of documents. The
+// documents are joined into one string with a separator byte between each
+// pair, so a single search covers every document at once.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "suffix_array.h"
+
+// Create a generalized suffix array over a collection of documents, sorting
+// its suffixes with the chosen method. The separator is the lowest byte that
+// appears in no document, so no pattern without it can match across the end
+// of a document. Every document must be a null-terminated string, and empty
+// documents are allowed as long as the collection isn't empty overall.
+document_collection* new_document_collection(
+    char** documents,
+    int document_count,
+    sort_method method,
+    int threads
+) {
+    int byte;
+    int document;
+    size_t length;
+    size_t total_length;
+    char* string;
+    unsigned char present[ALPHABET_SIZE] = {0};
+    document_collection* collection;
+
+    if (documents == NULL || document_count < 1) {
+        return NULL;
+    }
+
+    // Measure the documents and note every byte they use. The joined string
+    // has one separator fewer than it has documents.
+    total_length = document_count - 1;
+    for (document = 0; document < document_count; document++) {
+        if (documents[document] == NULL) {
+            return NULL;
+        }
+        for (length = 0; documents[document][length] != '\0'; length++) {
+            present[(unsigned char) documents[document][length]] = 1;
+        }
+        total_length += length;
+        if (total_length >= (size_t) TEXT_POSITION_MAX - 1) {
+            return NULL;
+        }
+    }
+
+    // Every byte but the null terminator is already taken.
+    for (byte = 1; byte < ALPHABET_SIZE && present[byte]; byte++);
+    if (byte == ALPHABET_SIZE) {
+        return NULL;
+    }
+
+    if ((collection = calloc(1, sizeof(document_collection))) == NULL) {
+        return NULL;
+    }
+    collection->separator = (char) byte;
+    collection->document_count = document_count;
+    if ((collection->starts = malloc(sizeof(text_position) * (document_count + 1))) == NULL) {
+        destroy_document_collection(collection);
+
+        return NULL;
+    }
+    if ((string = malloc(sizeof(char) * (total_length + 1))) == NULL) {
+        destroy_document_collection(collection);
+
+        return NULL;
+    }
+
+    // Join the documents, remembering where each one starts. The entry past
+    // the last document is where a separator after it would end.
+    length = 0;
+    for (document = 0; document < document_count; document++) {
+        if (document > 0) {
+            string[length++] = collection->separator;
+        }
+        collection->starts[document] = length;
+        strcpy(string + length, documents[document]);
+        length += strlen(documents[document]);
+    }
+    collection->starts[document_count] = length + 1;
+    string[length] = '\0';
+
+    collection->array = new_suffix_array_using(string, method, threads);
+    free(string);
+    if (collection->array == NULL) {
+        destroy_document_collection(collection);
+
+        return NULL;
+    }
+
+    return collection;
+}
+
+// Find the document that a position of the joined string belongs to. A
+// separator belongs to the document before it.
+int document_of(document_collection* collection, text_position position) {
+    int low;
+    int high;
+    int mid;
+
+    // Find the last document that starts at or before the position.
+    low = 0;
+    high = collection->document_count;
+    while (high - low > 1) {
+        mid = low + (high - low) / 2;
+        if (collection->starts[mid] <= position) {
+            low = mid;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+// Find the range of sorted suffixes that start with a pattern. Patterns that
+// contain the separator could match across documents, so they aren't valid.
+flag document_search_range(document_collection* collection, char* pattern, suffix_range* range) {
+
+    if (collection == NULL || pattern == NULL || strchr(pattern, collection->separator) != NULL) {
+        return FLAG_FAILURE;
+    }
+
+    return search_range(collection->array, pattern, range);
+}
+
+// Retrieve the next occurrence in a range of sorted suffixes as a document and
+// an offset within it, shrinking the range. The occurrences come out in sorted
+// suffix order, not document order.
+flag next_document_hit(document_collection* collection, suffix_range* range, document_hit* hit) {
+    text_position position;
+
+    if (collection == NULL || hit == NULL) {
+        return FLAG_FAILURE;
+    }
+    if ((position = next_occurrence(collection->array, range)) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
+    }
+
+    hit->document = document_of(collection, position);
+    hit->offset = position - collection->starts[hit->document];
+
+    return FLAG_SUCCESS;
+}
+
+// List the documents that hold at least one occurrence in a range of sorted
+// suffixes, saving them in increasing order in documents, which must have
+// room for every document in the collection. Each occurrence is visited once,
+// and the documents seen are marked in a bit per document. Returns the number
+// of documents listed.
+int list_documents(document_collection* collection, suffix_range* range, int* documents) {
+    int word;
+    int listed;
+    int document;
+    text_position index;
+    unsigned long long bits;
+    unsigned long long* seen;
+
+    if (collection == NULL || range == NULL || documents == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    if ((seen = calloc(collection->document_count / 64 + 1, sizeof(unsigned long long))) == NULL) {
+        return FLAG_FAILURE;
+    }
+    for (index = range->low; index < range->high; index++) {
+        document = document_of(collection, suffix_at(collection->array, index));
+        seen[document / 64] |= 1ULL << (document % 64);
+    }
+
+    // Read the marks back a word at a time, lowest document first.
+    listed = 0;
+    for (word = 0; word <= collection->document_count / 64; word++) {
+        for (bits = seen[word]; bits != 0; bits &= bits - 1) {
+            documents[listed++] = word * 64 + __builtin_ctzll(bits);
+        }
+    }
+    free(seen);
+
+    return listed;
+}
+
+// Destroy a document collection and its suffix array.
+void destroy_document_collection(document_collection* collection) {
+
+    if (collection == NULL) {
+        return;
+    }
+
+    destroy_suffix_array(collection->array);
+    free(collection->starts);
+    free(collection);
+}
@@ -4,119 +4,1251 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "suffix_array.h"
 
-// Read a file into a dynamic character array.
-char* read_file(char* file_name) {
-    FILE* file;
-    char buffer;
+// Read a file into a dynamic character array in a single pass. Regular files
+// are memory mapped and filtered straight into a string of the same size.
+// Anything else, like a pipe, is read in large blocks.
+char* read_file(char* file_name, int keep_all) {
+    int file;
     char* string;
-    int characters;
-    int string_index;
+    char* resized;
+    char* mapping;
+    char* block;
+    size_t kept;
+    size_t capacity;
+    ssize_t bytes_read;
+    struct stat status;
 
     // Attempt to open the file.
-    if ((file = fopen(file_name, "r")) == NULL) {
+    if ((file = open(file_name, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(file, &status) != 0) {
+        close(file);
+
+        return NULL;
+    }
+
+    // The string can never be longer than a regular file.
+    capacity = (S_ISREG(status.st_mode)) ? (size_t) status.st_size : READ_BLOCK_SIZE;
+    if ((string = malloc(sizeof(char) * (capacity + 1))) == NULL) {
+        close(file);
+
         return NULL;
     }
-    
-    // Count the number of valid characters in the file.
-    characters = 0;
-    while (fscanf(file, "%c", &buffer) != EOF) {
-        if (is_alphabetic(buffer)) {
-            characters++;
+
+    kept = 0;
+    mapping = MAP_FAILED;
+    if (S_ISREG(status.st_mode) && status.st_size > 0) {
+        mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    if (mapping != MAP_FAILED) {
+        madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+        kept = filter_characters(mapping, status.st_size, string, keep_all);
+        munmap(mapping, status.st_size);
+    }
+    else if ((block = malloc(sizeof(char) * READ_BLOCK_SIZE)) != NULL) {
+
+        // Grow the string whenever a full block might not fit.
+        while ((bytes_read = read(file, block, READ_BLOCK_SIZE)) > 0) {
+            if (kept + bytes_read > capacity) {
+                capacity = 2 * capacity + bytes_read;
+                if ((resized = realloc(string, sizeof(char) * (capacity + 1))) == NULL) {
+                    break;
+                }
+                string = resized;
+            }
+            kept += filter_characters(block, bytes_read, string + kept, keep_all);
+        }
+        free(block);
+        if (bytes_read != 0) {
+            free(string);
+            close(file);
+
+            return NULL;
+        }
+    }
+    else {
+        free(string);
+        close(file);
+
+        return NULL;
+    }
+    close(file);
+
+    // All good things must come to an end. Give back any space that
+    // filtering freed up, if the system is willing.
+    string[kept] = '\0';
+    if ((resized = realloc(string, sizeof(char) * (kept + 1))) != NULL) {
+        string = resized;
+    }
+
+    return string;
+}
+
+// Report how long a build took on standard error, so it never mixes with
+// batch output.
+void report_build_time(struct timespec* start_time, struct timespec* end_time) {
+    fprintf(
+        stderr,
+        "Built the suffix array in %.3f seconds.\n",
+        (end_time->tv_sec - start_time->tv_sec) + (end_time->tv_nsec - start_time->tv_nsec) / 1e9
+    );
+}
+
+// Analyses of repeated and shared substrings that can replace searching.
+typedef enum analysis_kind {
+    ANALYSIS_NONE,
+    ANALYSIS_LONGEST_REPEAT,
+    ANALYSIS_REPEATS,
+    ANALYSIS_COMMON,
+    ANALYSIS_MUMS
+} analysis_kind;
+
+// Settings chosen with command line options.
+typedef struct driver_options {
+    sort_method method;
+    dump_mode dump;
+    text_position dump_length;
+    int use_dump;
+    int build_lcp;
+    int show_all;
+    int load_index;
+    int threads;
+    int report_time;
+    int pack;
+    int bit_pack;
+    int keep_all;
+    int use_fm;
+    int use_prefix_table;
+    int prefix_length;
+    int use_search_layout;
+    int use_documents;
+    int use_appends;
+    int report_stats;
+    int use_approximate;
+    int max_distance;
+    distance_measure measure;
+    analysis_kind analysis;
+    text_position min_length;
+    text_position layout_spacing;
+    size_t cache_entries;
+    int use_cache;
+    text_position sample_rate;
+    size_t memory_budget;
+    char* save_file;
+    char* batch_file;
+    char* external_file;
+    char* temporary_directory;
+} driver_options;
+
+// Parse a whole argument as a positive length that fits in a text position.
+// Returns 0 if it isn't one.
+static text_position parse_length(char* argument) {
+    char* end;
+    long long value;
+
+    errno = 0;
+    value = strtoll(argument, &end, 10);
+    if (end == argument || *end != '\0' || errno == ERANGE || value < 1 || value > TEXT_POSITION_MAX) {
+        return 0;
+    }
+
+    return (text_position) value;
+}
+
+// Consume any options that precede the string or file. Returns the index of
+// the first argument that isn't an option.
+int parse_options(int argument_count, char** arguments, driver_options* options) {
+    int argument;
+
+    memset(options, 0, sizeof(driver_options));
+    options->method = SORT_INDUCED;
+    options->sample_rate = FM_SAMPLE_RATE;
+    options->memory_budget = EXTERNAL_DEFAULT_MEMORY;
+    options->min_length = 1;
+
+    argument = 1;
+    while (argument < argument_count && strncmp(arguments[argument], "--", 2) == 0) {
+        if (strcmp(arguments[argument], "--radix") == 0) {
+            options->method = SORT_RADIX;
+        }
+        else if (strcmp(arguments[argument], "--counting") == 0) {
+            options->method = SORT_COUNTING;
+        }
+        else if (strcmp(arguments[argument], "--parallel") == 0) {
+            options->method = SORT_PARALLEL;
+        }
+        else if (strcmp(arguments[argument], "--time") == 0) {
+            options->report_time = 1;
+        }
+        else if (strcmp(arguments[argument], "--stats") == 0) {
+            options->report_stats = 1;
+        }
+        else if (strcmp(arguments[argument], "--stats-json") == 0) {
+            options->report_stats = 2;
+        }
+        else if (strcmp(arguments[argument], "--lcp") == 0) {
+            options->build_lcp = 1;
+        }
+        else if (strcmp(arguments[argument], "--pack") == 0) {
+            options->pack = 1;
+        }
+        else if (strcmp(arguments[argument], "--pack-bits") == 0) {
+            options->bit_pack = 1;
+        }
+        else if (strcmp(arguments[argument], "--bytes") == 0) {
+            options->keep_all = 1;
+        }
+        else if (strcmp(arguments[argument], "--fm") == 0) {
+            options->use_fm = 1;
+        }
+        else if (strcmp(arguments[argument], "--all") == 0) {
+            options->show_all = 1;
+        }
+        else if (strcmp(arguments[argument], "--documents") == 0) {
+            options->use_documents = 1;
+        }
+        else if (strcmp(arguments[argument], "--append") == 0) {
+            options->use_appends = 1;
+        }
+        else if (strcmp(arguments[argument], "--load") == 0) {
+            options->load_index = 1;
+        }
+        else if (strcmp(arguments[argument], "--save") == 0 && argument + 1 < argument_count) {
+            options->save_file = arguments[++argument];
+        }
+        else if (strcmp(arguments[argument], "--batch") == 0 && argument + 1 < argument_count) {
+            options->batch_file = arguments[++argument];
+        }
+        else if (strcmp(arguments[argument], "--external") == 0 && argument + 1 < argument_count) {
+            options->external_file = arguments[++argument];
+        }
+        else if (strcmp(arguments[argument], "--memory") == 0 && argument + 1 < argument_count) {
+            options->memory_budget = (size_t) atoll(arguments[++argument]) * 1048576;
+        }
+        else if (strcmp(arguments[argument], "--temp") == 0 && argument + 1 < argument_count) {
+            options->temporary_directory = arguments[++argument];
+        }
+        else if (strcmp(arguments[argument], "--dump") == 0 && argument + 1 < argument_count) {
+            argument++;
+            options->use_dump = 1;
+            if (strcmp(arguments[argument], "full") == 0) {
+                options->dump = DUMP_FULL;
+            }
+            else if (strcmp(arguments[argument], "none") == 0) {
+                options->dump = DUMP_NONE;
+            }
+            else if (strcmp(arguments[argument], "indices") == 0) {
+                options->dump = DUMP_INDICES;
+            }
+            else if ((options->dump_length = parse_length(arguments[argument])) > 0) {
+                options->dump = DUMP_TRUNCATED;
+            }
+            else {
+                printf("Unknown dump mode '%s'.\n", arguments[argument]);
+
+                return FLAG_FAILURE;
+            }
+        }
+        else if (strcmp(arguments[argument], "--mismatches") == 0 && argument + 1 < argument_count) {
+            options->max_distance = atoi(arguments[++argument]);
+            options->measure = DISTANCE_HAMMING;
+            options->use_approximate = 1;
+        }
+        else if (strcmp(arguments[argument], "--edits") == 0 && argument + 1 < argument_count) {
+            options->max_distance = atoi(arguments[++argument]);
+            options->measure = DISTANCE_EDIT;
+            options->use_approximate = 1;
+        }
+        else if (strcmp(arguments[argument], "--analyze") == 0 && argument + 1 < argument_count) {
+            argument++;
+            if (strcmp(arguments[argument], "longest-repeat") == 0) {
+                options->analysis = ANALYSIS_LONGEST_REPEAT;
+            }
+            else if (strcmp(arguments[argument], "repeats") == 0) {
+                options->analysis = ANALYSIS_REPEATS;
+            }
+            else if (strcmp(arguments[argument], "common") == 0) {
+                options->analysis = ANALYSIS_COMMON;
+            }
+            else if (strcmp(arguments[argument], "mums") == 0) {
+                options->analysis = ANALYSIS_MUMS;
+            }
+            else {
+                printf("Unknown analysis '%s'.\n", arguments[argument]);
+
+                return FLAG_FAILURE;
+            }
+        }
+        else if (
+            strcmp(arguments[argument], "--min-length") == 0
+            && argument + 1 < argument_count
+            && (options->min_length = atoll(arguments[argument + 1])) > 0
+        ) {
+            argument++;
+        }
+        else if (
+            strcmp(arguments[argument], "--cache") == 0
+            && argument + 1 < argument_count
+            && atoll(arguments[argument + 1]) > 0
+        ) {
+            options->cache_entries = (size_t) atoll(arguments[++argument]);
+            options->use_cache = 1;
+        }
+        else if (strcmp(arguments[argument], "--threads") == 0 && argument + 1 < argument_count) {
+            options->threads = atoi(arguments[++argument]);
+        }
+        else if (strcmp(arguments[argument], "--prefix-table") == 0 && argument + 1 < argument_count) {
+            options->prefix_length = atoi(arguments[++argument]);
+            options->use_prefix_table = 1;
+        }
+        else if (strcmp(arguments[argument], "--layout") == 0 && argument + 1 < argument_count) {
+            options->layout_spacing = atoll(arguments[++argument]);
+            options->use_search_layout = 1;
+        }
+        else if (
+            strcmp(arguments[argument], "--sample-rate") == 0
+            && argument + 1 < argument_count
+            && (options->sample_rate = atoll(arguments[argument + 1])) > 0
+        ) {
+            argument++;
+        }
+        else {
+            printf("Unknown option '%s'.\n", arguments[argument]);
+
+            return FLAG_FAILURE;
+        }
+        argument++;
+    }
+
+    return argument;
+}
+
+// Create a suffix array from an index file, a text file, or the source string
+// itself, in that order of preference. The sanitized text of a file is saved
+// in string so it can be freed later. An external build writes an index file
+// from a text file and then loads it.
+suffix_array* create_suffix_array(driver_options* options, char* source, char** string) {
+    suffix_array* array;
+    unsigned long long start_time;
+
+    *string = NULL;
+
+    // Sort the text through temporary files, then load the index it wrote.
+    if (options->external_file != NULL) {
+        if (
+            build_external_index(
+                source,
+                options->external_file,
+                options->keep_all,
+                options->memory_budget,
+                options->temporary_directory
+            ) == FLAG_FAILURE
+        ) {
+            printf("Something went wrong while building the index file '%s'!\n", options->external_file);
+
+            return NULL;
+        }
+        if ((array = load_suffix_array(options->external_file)) == NULL) {
+            printf("Something went wrong while loading the index file '%s'!\n", options->external_file);
+        }
+
+        return array;
+    }
+
+    // Load a saved index file instead of building the suffix array.
+    if (options->load_index) {
+        if ((array = load_suffix_array(source)) == NULL) {
+            printf("Something went wrong while loading the index file '%s'!\n", source);
+        }
+
+        return array;
+    }
+
+    // Attempt to use the source as a file name. If this fails,
+    // create a suffix array using the source as a string.
+    start_time = STATS_TIME();
+    *string = read_file(source, options->keep_all);
+    STATS_PHASE(PHASE_READ, start_time);
+    if (*string == NULL) {
+        if ((array = new_suffix_array_using(source, options->method, options->threads)) == NULL) {
+            printf(
+                "Something went wrong while creating the suffix array from '%s'!\n",
+                source
+            );
+        }
+    }
+
+    // The source was a file name. Use the new, sanitized string
+    // to create a suffix array.
+    else {
+        if ((array = new_suffix_array_using(*string, options->method, options->threads)) == NULL) {
+            printf(
+                "Something went wrong while creating the suffix array from '%s'!\n",
+                *string
+            );
+            free(*string);
+            *string = NULL;
         }
     }
 
-    // Allocate a character array to hold the valid characters.
-    if ((string = malloc(sizeof(char) * (characters + 1))) == NULL) {
+    return array;
+}
+
+// Build the search structures that were asked for and pack the suffixes,
+// reporting the first thing that goes wrong.
+flag prepare_suffix_array(suffix_array* array, driver_options* options) {
+
+    // Build the LCP tables to speed up searching, if requested.
+    if (options->build_lcp && build_lcp_array(array) == FLAG_FAILURE) {
+        printf("Something went wrong while building the LCP array!\n");
+
+        return FLAG_FAILURE;
+    }
+
+    // Build the prefix table to skip the top of every search, if requested.
+    if (
+        options->use_prefix_table
+        && build_prefix_table(array, options->prefix_length) == FLAG_FAILURE
+    ) {
+        printf("Something went wrong while building the prefix table!\n");
+
+        return FLAG_FAILURE;
+    }
+
+    // Build the search layout to keep the top of every search in cache, if requested.
+    if (
+        options->use_search_layout
+        && build_search_layout(array, options->layout_spacing) == FLAG_FAILURE
+    ) {
+        printf("Something went wrong while building the search layout!\n");
+
+        return FLAG_FAILURE;
+    }
+
+    // Build the query cache to answer repeated patterns at once, if requested.
+    if (options->use_cache && build_query_cache(array, options->cache_entries) == FLAG_FAILURE) {
+        printf("Something went wrong while building the query cache!\n");
+
+        return FLAG_FAILURE;
+    }
+
+    // Pack the suffixes to save memory, if requested. Bit packing saves
+    // the most, so it wins if both were asked for.
+    if (options->pack && !options->bit_pack && pack_suffixes(array) == FLAG_FAILURE) {
+        printf("Something went wrong while packing the suffixes!\n");
+
+        return FLAG_FAILURE;
+    }
+
+    // Or pack them down to as few bits as the string length allows.
+    if (options->bit_pack && bit_pack_suffixes(array) == FLAG_FAILURE) {
+        printf("Something went wrong while bit packing the suffixes!\n");
+
+        return FLAG_FAILURE;
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Answer the patterns in a batch file, or standard input if the file is "-".
+// The patterns are answered with the FM-index if there is one.
+flag run_batch(suffix_array* array, fm_index* index, driver_options* options) {
+    flag result;
+    FILE* file;
+    query_batch* batch;
+
+    if (strcmp(options->batch_file, "-") == 0) {
+        file = stdin;
+    }
+    else if ((file = fopen(options->batch_file, "r")) == NULL) {
+        printf("Couldn't open the batch file '%s'!\n", options->batch_file);
+
+        return FLAG_FAILURE;
+    }
+
+    batch = read_query_batch(file);
+    if (file != stdin) {
         fclose(file);
+    }
+    if (batch == NULL) {
+        printf("Something went wrong while reading the batch file '%s'!\n", options->batch_file);
 
+        return FLAG_FAILURE;
+    }
+
+    if (index != NULL) {
+        result = run_fm_query_batch(index, batch, options->threads);
+    }
+    else {
+        result = run_query_batch(array, batch, options->threads);
+    }
+    if (result == FLAG_FAILURE) {
+        printf("Something went wrong while answering the batch!\n");
+        destroy_query_batch(batch);
+
+        return FLAG_FAILURE;
+    }
+    if (index != NULL) {
+        print_fm_query_batch(index, batch);
+    }
+    else {
+        print_query_batch(array, batch);
+    }
+    destroy_query_batch(batch);
+
+    return FLAG_SUCCESS;
+}
+
+// Replace a suffix array with an FM-index and answer every pattern with it.
+// The string isn't kept, so occurrences are reported by position only.
+flag run_fm_index(suffix_array* array, driver_options* options, char** patterns, int pattern_count) {
+    int pattern;
+    flag result;
+    text_position position;
+    text_position length;
+    suffix_range range;
+    fm_index* index;
+
+    length = array->string_length;
+    index = new_fm_index(array, options->sample_rate);
+    destroy_suffix_array(array);
+    if (index == NULL) {
+        printf("Something went wrong while building the FM-index!\n");
+
+        return FLAG_FAILURE;
+    }
+
+    if (options->batch_file != NULL) {
+        result = run_batch(NULL, index, options);
+        destroy_fm_index(index);
+
+        return result;
+    }
+
+    printf(
+        "FM-index of " TEXT_POSITION_FORMAT " characters uses %zu bytes (%.2f per character).\n",
+        length,
+        fm_index_size(index),
+        (double) fm_index_size(index) / length
+    );
+    for (pattern = 0; pattern < pattern_count; pattern++) {
+        printf("Searching for '%s': ", patterns[pattern]);
+        if (fm_search_range(index, patterns[pattern], &range) == FLAG_FAILURE) {
+            printf("not a valid pattern!\n");
+        }
+        else if (range.low == range.high) {
+            printf("not found!\n");
+        }
+        else {
+            printf(
+                "found " TEXT_POSITION_FORMAT " time%s!\n",
+                range.high - range.low,
+                (range.high - range.low == 1) ? "" : "s"
+            );
+            while ((position = fm_next_occurrence(index, &range)) != FLAG_FAILURE) {
+                printf("Position " TEXT_POSITION_FORMAT "\n", position);
+                if (!options->show_all) {
+                    break;
+                }
+            }
+        }
+    }
+    destroy_fm_index(index);
+
+    return FLAG_SUCCESS;
+}
+
+// Split a list of file names, one per line, in place. Empty lines are
+// skipped. Returns a new array of the names, which the caller must free.
+char** split_lines(char* list, int* line_count) {
+    int name;
+    char* line;
+    char** names;
+
+    // End every line, counting them as we go.
+    *line_count = 0;
+    for (line = list; *line != '\0'; line++) {
+        if (*line == '\n' || *line == '\r') {
+            *line = '\0';
+        }
+        else if (line == list || *(line - 1) == '\0') {
+            (*line_count)++;
+        }
+    }
+
+    if ((names = malloc(sizeof(char*) * (*line_count + 1))) == NULL) {
         return NULL;
     }
+    name = 0;
+    for (line = list; name < *line_count; line++) {
+        if (*line != '\0' && (line == list || *(line - 1) == '\0')) {
+            names[name++] = line;
+        }
+    }
 
-    // Go back to the beginning for more fun!
-    rewind(file);
+    return names;
+}
+
+// Read every named document into a new array of strings.
+char** read_documents(driver_options* options, char** names, int document_count) {
+    int document;
+    char** documents;
 
-    // Save all valid characters from the file in the new character array.
-    string_index = 0;
-    while (fscanf(file, "%c", &buffer) != EOF) {
-        if (is_alphabetic(buffer)) {
-            string[string_index] = buffer;        
-            string_index++;
+    if ((documents = calloc(document_count + 1, sizeof(char*))) == NULL) {
+        return NULL;
+    }
+    for (document = 0; document < document_count; document++) {
+        if ((documents[document] = read_file(names[document], options->keep_all)) == NULL) {
+            printf("Couldn't read the document '%s'!\n", names[document]);
+            for (document--; document >= 0; document--) {
+                free(documents[document]);
+            }
+            free(documents);
+
+            return NULL;
         }
     }
 
-    // All good things must come to an end.
-    string[string_index] = '\0';
+    return documents;
+}
 
-    fclose(file);
+// Report how well the query cache of a suffix array did on standard error, if
+// it has one, so it never mixes with batch output.
+void report_cache(suffix_array* array) {
 
-    return string;
+    if (array->cache == NULL) {
+        return;
+    }
+
+    fprintf(
+        stderr,
+        "Query cache: %llu hit%s, %llu miss%s.\n",
+        array->cache->hits,
+        (array->cache->hits == 1) ? "" : "s",
+        array->cache->misses,
+        (array->cache->misses == 1) ? "" : "es"
+    );
+}
+
+// Build one suffix array over every document named in a list file and answer
+// every pattern with it. Each occurrence is reported as a position within the
+// document that holds it, after the list of documents that hold any.
+flag run_documents(driver_options* options, char* list_file, char** patterns, int pattern_count) {
+    int pattern;
+    int document;
+    int document_count;
+    int listed;
+    int* listing;
+    char* list;
+    char** names;
+    char** documents;
+    struct timespec start_time;
+    struct timespec end_time;
+    suffix_range range;
+    document_hit hit;
+    document_collection* collection;
+
+    if ((list = read_file(list_file, 1)) == NULL) {
+        printf("Couldn't read the document list '%s'!\n", list_file);
+
+        return FLAG_FAILURE;
+    }
+    if ((names = split_lines(list, &document_count)) == NULL) {
+        free(list);
+
+        return FLAG_FAILURE;
+    }
+    if ((documents = read_documents(options, names, document_count)) == NULL) {
+        free(names);
+        free(list);
+
+        return FLAG_FAILURE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    collection = new_document_collection(documents, document_count, options->method, options->threads);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    for (document = 0; document < document_count; document++) {
+        free(documents[document]);
+    }
+    free(documents);
+    if (collection == NULL) {
+        printf("Something went wrong while indexing the documents in '%s'!\n", list_file);
+        free(names);
+        free(list);
+
+        return FLAG_FAILURE;
+    }
+    if (options->report_time) {
+        report_build_time(&start_time, &end_time);
+    }
+
+    if (
+        prepare_suffix_array(collection->array, options) == FLAG_FAILURE
+        || (listing = malloc(sizeof(int) * document_count)) == NULL
+    ) {
+        destroy_document_collection(collection);
+        free(names);
+        free(list);
+
+        return FLAG_FAILURE;
+    }
+
+    printf(
+        "Indexed %d document%s (" TEXT_POSITION_FORMAT " characters).\n",
+        document_count,
+        (document_count == 1) ? "" : "s",
+        collection->array->string_length - (document_count - 1)
+    );
+    for (pattern = 0; pattern < pattern_count; pattern++) {
+        printf("Searching for '%s': ", patterns[pattern]);
+        if (document_search_range(collection, patterns[pattern], &range) == FLAG_FAILURE) {
+            printf("not a valid pattern!\n");
+        }
+        else if (range.low == range.high) {
+            printf("not found!\n");
+        }
+        else if ((listed = list_documents(collection, &range, listing)) == FLAG_FAILURE) {
+            printf("something went wrong while listing its documents!\n");
+        }
+        else {
+            printf(
+                "found " TEXT_POSITION_FORMAT " time%s in %d document%s!\n",
+                range.high - range.low,
+                (range.high - range.low == 1) ? "" : "s",
+                listed,
+                (listed == 1) ? "" : "s"
+            );
+            for (document = 0; document < listed; document++) {
+                printf("Found in '%s'.\n", names[listing[document]]);
+            }
+            while (next_document_hit(collection, &range, &hit) != FLAG_FAILURE) {
+                printf(
+                    "Position " TEXT_POSITION_FORMAT " of '%s'.\n",
+                    hit.offset,
+                    names[hit.document]
+                );
+                if (!options->show_all) {
+                    break;
+                }
+            }
+        }
+    }
+
+    free(listing);
+    report_cache(collection->array);
+    destroy_document_collection(collection);
+    free(names);
+    free(list);
+
+    return FLAG_SUCCESS;
+}
+
+// Grow an appendable index one file at a time, for every file named in a list
+// file, and answer every pattern with it. Each file is reported as it's added.
+flag run_appends(driver_options* options, char* list_file, char** patterns, int pattern_count) {
+    int file;
+    int file_count;
+    int pattern;
+    flag result;
+    char* list;
+    char* text;
+    char** names;
+    text_position count;
+    text_position occurrence;
+    text_position* positions;
+    struct timespec start_time;
+    struct timespec end_time;
+    appendable_index* index;
+
+    if ((list = read_file(list_file, 1)) == NULL) {
+        printf("Couldn't read the file list '%s'!\n", list_file);
+
+        return FLAG_FAILURE;
+    }
+    if ((names = split_lines(list, &file_count)) == NULL) {
+        free(list);
+
+        return FLAG_FAILURE;
+    }
+    if ((index = new_appendable_index(options->method, options->threads)) == NULL) {
+        free(names);
+        free(list);
+
+        return FLAG_FAILURE;
+    }
+
+    // Only one file is ever held in memory besides the index itself.
+    for (file = 0; file < file_count; file++) {
+        if ((text = read_file(names[file], options->keep_all)) == NULL) {
+            printf("Couldn't read the file '%s'!\n", names[file]);
+            destroy_appendable_index(index);
+            free(names);
+            free(list);
+
+            return FLAG_FAILURE;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        result = append_text(index, text);
+        clock_gettime(CLOCK_MONOTONIC, &end_time);
+        free(text);
+        if (result == FLAG_FAILURE) {
+            printf("Something went wrong while appending '%s'!\n", names[file]);
+            destroy_appendable_index(index);
+            free(names);
+            free(list);
+
+            return FLAG_FAILURE;
+        }
+        if (options->report_time) {
+            report_build_time(&start_time, &end_time);
+        }
+        printf(
+            "Appended '%s' (" TEXT_POSITION_FORMAT " characters in %d tier%s).\n",
+            names[file],
+            index->string_length,
+            index->tier_count,
+            (index->tier_count == 1) ? "" : "s"
+        );
+    }
+
+    // Unless every occurrence was requested, only the first one in the
+    // string is shown.
+    for (pattern = 0; pattern < pattern_count; pattern++) {
+        printf("Searching for '%s': ", patterns[pattern]);
+        if ((count = appendable_find_occurrences(index, patterns[pattern], &positions)) == FLAG_FAILURE) {
+            printf("not a valid pattern!\n");
+        }
+        else if (count == 0) {
+            printf("not found!\n");
+        }
+        else {
+            printf("found " TEXT_POSITION_FORMAT " time%s!\n", count, (count == 1) ? "" : "s");
+            for (occurrence = 0; occurrence < count; occurrence++) {
+                printf("Position " TEXT_POSITION_FORMAT "\n", positions[occurrence]);
+                if (!options->show_all) {
+                    break;
+                }
+            }
+        }
+        free(positions);
+    }
+
+    destroy_appendable_index(index);
+    free(names);
+    free(list);
+
+    return FLAG_SUCCESS;
+}
+
+// Search for a pattern approximately, printing each position it nearly
+// appears at with its distance. Unless every hit was requested, only the
+// first one in the string is shown.
+void run_approximate_search(suffix_array* array, driver_options* options, char* pattern) {
+    text_position count;
+    text_position hit;
+    approximate_hit* hits;
+
+    if (options->measure == DISTANCE_HAMMING) {
+        printf(
+            "Searching for '%s' with up to %d mismatch%s: ",
+            pattern,
+            options->max_distance,
+            (options->max_distance == 1) ? "" : "es"
+        );
+    }
+    else {
+        printf(
+            "Searching for '%s' with up to %d edit%s: ",
+            pattern,
+            options->max_distance,
+            (options->max_distance == 1) ? "" : "s"
+        );
+    }
+    if ((count = approximate_search(array, pattern, options->max_distance, options->measure, &hits)) == FLAG_FAILURE) {
+        printf("not a valid pattern!\n");
+    }
+    else if (count == 0) {
+        printf("not found!\n");
+    }
+    else {
+        printf("found " TEXT_POSITION_FORMAT " time%s!\n", count, (count == 1) ? "" : "s");
+        for (hit = 0; hit < count; hit++) {
+            printf("Position " TEXT_POSITION_FORMAT " (distance %d)\n", hits[hit].position, hits[hit].distance);
+            if (!options->show_all) {
+                break;
+            }
+        }
+    }
+    free(hits);
+}
+
+// Report the longest repeat of a suffix array, or stream out all of its
+// maximal repeats, depending on the analysis requested.
+flag run_repeat_analysis(suffix_array* array, driver_options* options) {
+    text_position first;
+    text_position second;
+    text_position length;
+    text_position count;
+
+    if (options->analysis == ANALYSIS_LONGEST_REPEAT) {
+        if (longest_repeat(array, &first, &second, &length) == FLAG_FAILURE) {
+            printf("Something went wrong while looking for the longest repeat!\n");
+
+            return FLAG_FAILURE;
+        }
+        if (length == 0) {
+            printf("No character repeats.\n");
+        }
+        else {
+            printf(
+                "Longest repeat: " TEXT_POSITION_FORMAT " characters, at positions "
+                TEXT_POSITION_FORMAT " and " TEXT_POSITION_FORMAT ":\n",
+                length,
+                first,
+                second
+            );
+            print_highlighted_substring(array, first, length);
+        }
+
+        return FLAG_SUCCESS;
+    }
+
+    printf("Maximal repeats of at least " TEXT_POSITION_FORMAT " characters (length, occurrences, position):\n", options->min_length);
+    if ((count = print_maximal_repeats(array, options->min_length, stdout)) == FLAG_FAILURE) {
+        printf("Something went wrong while looking for maximal repeats!\n");
+
+        return FLAG_FAILURE;
+    }
+    printf("Found " TEXT_POSITION_FORMAT " maximal repeat%s.\n", count, (count == 1) ? "" : "s");
+
+    return FLAG_SUCCESS;
+}
+
+// Compare two texts, each either a file or the argument itself, through a
+// suffix array over both. Depending on the analysis requested, report their
+// longest common substring or stream out their maximal unique matches.
+flag run_comparison(driver_options* options, char* first_source, char* second_source) {
+    int text;
+    flag result;
+    char* texts[2];
+    char* files[2];
+    text_position first;
+    text_position second;
+    text_position length;
+    text_position count;
+    struct timespec start_time;
+    struct timespec end_time;
+    document_collection* collection;
+
+    texts[0] = first_source;
+    texts[1] = second_source;
+    for (text = 0; text < 2; text++) {
+        if ((files[text] = read_file(texts[text], options->keep_all)) != NULL) {
+            texts[text] = files[text];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    collection = new_document_collection(texts, 2, options->method, options->threads);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    free(files[0]);
+    free(files[1]);
+    if (collection == NULL) {
+        printf("Something went wrong while indexing '%s' and '%s'!\n", first_source, second_source);
+
+        return FLAG_FAILURE;
+    }
+    if (options->report_time) {
+        report_build_time(&start_time, &end_time);
+    }
+
+    result = FLAG_SUCCESS;
+    if (options->analysis == ANALYSIS_COMMON) {
+        if ((result = longest_common_substring(collection, &first, &second, &length)) == FLAG_FAILURE) {
+            printf("Something went wrong while looking for the longest common substring!\n");
+        }
+        else if (length == 0) {
+            printf("The texts have no characters in common.\n");
+        }
+        else {
+            printf(
+                "Longest common substring: " TEXT_POSITION_FORMAT " characters, at position "
+                TEXT_POSITION_FORMAT " of the first text and " TEXT_POSITION_FORMAT " of the second:\n",
+                length,
+                first,
+                second
+            );
+            printf("%.*s\n", (int) length, collection->array->string + first);
+        }
+    }
+    else {
+        printf(
+            "Maximal unique matches of at least " TEXT_POSITION_FORMAT
+            " characters (first position, second position, length):\n",
+            options->min_length
+        );
+        if ((count = print_maximal_unique_matches(collection, options->min_length, stdout)) == FLAG_FAILURE) {
+            printf("Something went wrong while looking for maximal unique matches!\n");
+            result = FLAG_FAILURE;
+        }
+        else {
+            printf("Found " TEXT_POSITION_FORMAT " maximal unique match%s.\n", count, (count == 1) ? "" : "es");
+        }
+    }
+    destroy_document_collection(collection);
+
+    return result;
+}
+
+// Report the statistics on standard error, if requested, and turn the result
+// of a run into an exit status.
+int finish(driver_options* options, flag result) {
+
+    if (options->report_stats == 1) {
+        print_stats(stderr);
+    }
+    else if (options->report_stats == 2) {
+        print_stats_json(stderr);
+    }
+
+    return (result == FLAG_FAILURE) ? -1 : 0;
 }
 
 // Main entry point of the program.
 int main(int argument_count, char** arguments) {
-    int position;
     int argument;
+    text_position position;
     char* string;
+    flag result;
+    struct timespec start_time;
+    struct timespec end_time;
+    suffix_range range;
     suffix_array* array;
+    driver_options options;
+
+    if ((argument = parse_options(argument_count, arguments, &options)) == FLAG_FAILURE) {
+        return -1;
+    }
+    if (options.report_stats) {
+        enable_stats();
+    }
 
     // Yell at the user if she is missing arguments.
-    if (argument_count < 2) {
+    if (argument >= argument_count) {
         printf("First argument after --run must be a string or file.\n");
         printf("All arguments afterwards will be treated as search patterns.\n");
 
         return -1;
     }
 
-    // Attempt to use the first argument as a file name. If this fails,
-    // create a suffix array using the first argument as a string.
-    if ((string = read_file(arguments[1])) == NULL) {
-        if ((array = new_suffix_array(arguments[1])) == NULL) {
-            printf(
-                "Something went wrong while creating the suffix array from '%s'!\n",
-                arguments[1]
-            );
+    // Build the index one file at a time, if requested.
+    if (options.use_appends) {
+        if (
+            options.load_index || options.save_file != NULL || options.use_fm
+            || options.batch_file != NULL || options.use_documents || options.build_lcp
+            || options.use_prefix_table || options.use_search_layout
+            || options.pack || options.bit_pack || options.use_approximate
+            || options.analysis != ANALYSIS_NONE || options.use_cache || options.use_dump
+        ) {
+            printf("The --append option only works with --bytes, --time, --all, --threads, and sorting options.\n");
 
             return -1;
         }
+        result = run_appends(
+            &options,
+            arguments[argument],
+            arguments + argument + 1,
+            argument_count - argument - 1
+        );
+
+        return finish(&options, result);
     }
 
-    // The first argument was a file name. Use the new, sanitized string
-    // to create a suffix array.
-    else {
-        if ((array = new_suffix_array(string)) == NULL) {
-            printf(
-                "Something went wrong while creating the suffix array from '%s'!\n",
-                string
-            );
+    // Suffixes are only listed before ordinary searches.
+    if (
+        options.use_dump
+        && (options.use_fm || options.batch_file != NULL || options.use_documents || options.analysis != ANALYSIS_NONE)
+    ) {
+        printf("The --dump option can't be combined with --fm, --batch, --documents, or --analyze.\n");
+
+        return -1;
+    }
+
+    // Approximate searches walk the suffixes and the string directly.
+    if (
+        options.use_approximate
+        && (options.use_fm || options.batch_file != NULL || options.use_documents || options.max_distance < 0)
+    ) {
+        printf("The --mismatches and --edits options need a non-negative distance, and don't work with --fm, --batch, or --documents.\n");
+
+        return -1;
+    }
+
+    // The query cache only answers suffix array searches.
+    if (options.use_cache && (options.use_fm || options.analysis != ANALYSIS_NONE || options.use_approximate)) {
+        printf("The --cache option can't be combined with --fm, --analyze, --mismatches, or --edits.\n");
+
+        return -1;
+    }
+
+    // Analyses replace searching, and work on the suffixes directly.
+    if (
+        options.analysis != ANALYSIS_NONE
+        && (options.use_fm || options.batch_file != NULL || options.use_documents || options.use_approximate)
+    ) {
+        printf("The --analyze option can't be combined with --fm, --batch, --documents, --mismatches, or --edits.\n");
+
+        return -1;
+    }
+
+    // Compare two texts, if requested. They're indexed together, so there's
+    // no single suffix array to load or save.
+    if (options.analysis == ANALYSIS_COMMON || options.analysis == ANALYSIS_MUMS) {
+        if (options.load_index || options.save_file != NULL || options.external_file != NULL) {
+            printf("Comparing two texts can't be combined with --load, --save, or --external.\n");
+
+            return -1;
+        }
+        if (argument + 1 >= argument_count) {
+            printf("Comparing needs a second string or file after the first.\n");
+
+            return -1;
+        }
+
+        return finish(&options, run_comparison(&options, arguments[argument], arguments[argument + 1]));
+    }
+
+    // Index a whole collection of documents at once, if requested.
+    if (options.use_documents) {
+        if (options.load_index || options.save_file != NULL || options.use_fm || options.batch_file != NULL) {
+            printf("The --documents option can't be combined with --load, --save, --fm, or --batch.\n");
 
             return -1;
         }
+        result = run_documents(
+            &options,
+            arguments[argument],
+            arguments + argument + 1,
+            argument_count - argument - 1
+        );
+
+        return finish(&options, result);
+    }
+
+    // Time the construction on a wall clock, since parallel builds spread
+    // their work across threads.
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    if ((array = create_suffix_array(&options, arguments[argument], &string)) == NULL) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    argument++;
+
+    if (options.report_time) {
+        report_build_time(&start_time, &end_time);
+    }
+
+    // Build any search structures and pack the suffixes, if requested.
+    if (prepare_suffix_array(array, &options) == FLAG_FAILURE) {
+        free(string);
+        destroy_suffix_array(array);
+
+        return -1;
+    }
+
+    // Save the suffix array to an index file, if requested.
+    if (options.save_file != NULL && save_suffix_array(array, options.save_file) == FLAG_FAILURE) {
+        printf("Something went wrong while saving the index file '%s'!\n", options.save_file);
+        free(string);
+        destroy_suffix_array(array);
+
+        return -1;
+    }
+
+    // Trade the suffix array for a much smaller FM-index, if requested.
+    if (options.use_fm) {
+        result = run_fm_index(array, &options, arguments + argument, argument_count - argument);
+        free(string);
+
+        return finish(&options, result);
+    }
+
+    // Analyze the repeats of the string instead of searching, if requested.
+    if (options.analysis != ANALYSIS_NONE) {
+        result = run_repeat_analysis(array, &options);
+        free(string);
+        destroy_suffix_array(array);
+
+        return finish(&options, result);
     }
 
-    // Print the unsorted and sorted suffixes.
-    printf("Unsorted suffixes:\n");
-    print_unsorted_suffixes(array);
-    printf("\n");
-    printf("Sorted suffixes:\n");
-    print_sorted_suffixes(array);
-    printf("\n");
+    // Answer a batch of patterns in bulk, if requested. The output is meant
+    // for other programs, so the suffix listings are skipped.
+    if (options.batch_file != NULL) {
+        result = run_batch(array, NULL, &options);
+        report_cache(array);
+        free(string);
+        destroy_suffix_array(array);
+
+        return finish(&options, result);
+    }
 
-    // Run searches using the rest of the arguments.
-    for (argument = 2; argument < argument_count; argument++) {
+    // Print the unsorted and sorted suffixes, unless they were cut down or
+    // turned off. The unsorted positions would just count upwards, so only
+    // the sorted ones are listed when dumping indices.
+    if (options.dump == DUMP_FULL || options.dump == DUMP_TRUNCATED) {
+        printf("Unsorted suffixes:\n");
+        dump_suffixes(array, stdout, 0, options.dump, options.dump_length);
+        printf("\n");
+    }
+    if (options.dump != DUMP_NONE) {
+        printf("Sorted suffixes:\n");
+        dump_suffixes(array, stdout, 1, options.dump, options.dump_length);
+        printf("\n");
+    }
+
+    // Run searches using the rest of the arguments. Unless every occurrence
+    // was requested, only the first one in sorted order is shown.
+    for (; argument < argument_count; argument++) {
+        if (options.use_approximate) {
+            run_approximate_search(array, &options, arguments[argument]);
+            continue;
+        }
         printf("Searching for '%s': ", arguments[argument]);
-        if ((position = search(array, arguments[argument])) == FLAG_FAILURE) {
+        if (search_range(array, arguments[argument], &range) == FLAG_FAILURE) {
+            printf("not a valid pattern!\n");
+        }
+        else if (range.low == range.high) {
             printf("not found!\n");
         }
         else {
-            printf("found at position %d!\n", position);
-            print_highlighted_substring(array, position, strlen(arguments[argument]));
+            printf(
+                "found " TEXT_POSITION_FORMAT " time%s!\n",
+                range.high - range.low,
+                (range.high - range.low == 1) ? "" : "s"
+            );
+            while ((position = next_occurrence(array, &range)) != FLAG_FAILURE) {
+                printf("Position " TEXT_POSITION_FORMAT ":\n", position);
+                print_highlighted_substring(array, position, strlen(arguments[argument]));
+                if (!options.show_all) {
+                    break;
+                }
+            }
         }
     }
 
+    report_cache(array);
     free(string);
     destroy_suffix_array(array);
 
-    return 0;
+    return finish(&options, FLAG_SUCCESS);
 }
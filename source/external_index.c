@@ -0,0 +1,745 @@
+// Builds an index file for a string that may not fit in memory. Suffixes are
+// sorted by prefix doubling, where every round is a pair of external merge
+// sorts through temporary files, so memory use stays within a fixed budget no
+// matter how long the string is. The string itself is only ever streamed.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "suffix_array.h"
+
+// A buffered stream of fixed-size records in a temporary file. Streams read
+// and write at their own offsets, so several of them can share one file.
+typedef struct record_stream {
+    int file;
+    off_t offset;
+    off_t end;
+    char* buffer;
+    size_t capacity;
+    size_t filled;
+    size_t next;
+} record_stream;
+
+// The rank of the suffix at a position, as of the current round.
+typedef struct ranked_suffix {
+    text_position position;
+    text_position rank;
+} ranked_suffix;
+
+// The rank of a suffix and the rank of the suffix that starts the current
+// doubling distance after it, which together order it for the next round.
+typedef struct rank_pair {
+    text_position rank;
+    text_position next_rank;
+    text_position position;
+} rank_pair;
+
+// The settings shared by every external sort of one build.
+typedef struct external_settings {
+    size_t memory_budget;
+    char* directory;
+} external_settings;
+
+// Create a temporary file in a directory. The file is unlinked right away,
+// so it disappears once it's closed, even if the build is interrupted.
+static int open_temporary(char* directory) {
+    int file;
+    char* path;
+
+    if ((path = malloc(strlen(directory) + sizeof("/sufarrayXXXXXX"))) == NULL) {
+        return -1;
+    }
+    sprintf(path, "%s/sufarrayXXXXXX", directory);
+    if ((file = mkstemp(path)) >= 0) {
+        unlink(path);
+    }
+    free(path);
+
+    return file;
+}
+
+// Open a stream over the records of a file from one byte offset up to
+// another. Its buffer always holds a whole number of records.
+static flag open_stream(record_stream* stream, int file, off_t offset, off_t end, size_t record_size) {
+    stream->file = file;
+    stream->offset = offset;
+    stream->end = end;
+    stream->capacity = (EXTERNAL_BLOCK_SIZE / record_size) * record_size;
+    stream->filled = 0;
+    stream->next = 0;
+
+    return ((stream->buffer = malloc(stream->capacity)) == NULL) ? FLAG_FAILURE : FLAG_SUCCESS;
+}
+
+// Close a stream, leaving its file open.
+static void close_stream(record_stream* stream) {
+    free(stream->buffer);
+    stream->buffer = NULL;
+}
+
+// Read the next record of a stream. Returns 0 once the stream is exhausted,
+// or if the file can't be read.
+static int read_record(record_stream* stream, void* record, size_t record_size) {
+    ssize_t bytes_read;
+    size_t wanted;
+
+    if (stream->next == stream->filled) {
+        wanted = stream->capacity;
+        if ((off_t) wanted > stream->end - stream->offset) {
+            wanted = stream->end - stream->offset;
+        }
+        stream->filled = 0;
+        stream->next = 0;
+        while (stream->filled < wanted) {
+            bytes_read = pread(
+                stream->file,
+                stream->buffer + stream->filled,
+                wanted - stream->filled,
+                stream->offset
+            );
+            if (bytes_read <= 0) {
+                break;
+            }
+            stream->filled += bytes_read;
+            stream->offset += bytes_read;
+        }
+        if (stream->filled < record_size) {
+            return 0;
+        }
+    }
+
+    memcpy(record, stream->buffer + stream->next, record_size);
+    stream->next += record_size;
+
+    return 1;
+}
+
+// Write out every buffered record of a stream.
+static flag flush_stream(record_stream* stream) {
+    size_t written;
+    ssize_t bytes_written;
+
+    for (written = 0; written < stream->filled; written += bytes_written) {
+        bytes_written = pwrite(
+            stream->file,
+            stream->buffer + written,
+            stream->filled - written,
+            stream->offset + written
+        );
+        if (bytes_written <= 0) {
+            return FLAG_FAILURE;
+        }
+    }
+    stream->offset += stream->filled;
+    stream->filled = 0;
+
+    return FLAG_SUCCESS;
+}
+
+// Append a record to a stream, writing out the buffer whenever it fills up.
+static flag write_record(record_stream* stream, const void* record, size_t record_size) {
+
+    if (stream->filled + record_size > stream->capacity && flush_stream(stream) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
+    }
+    memcpy(stream->buffer + stream->filled, record, record_size);
+    stream->filled += record_size;
+
+    return FLAG_SUCCESS;
+}
+
+// Compare two ranked suffixes by position.
+static int compare_positions(const void* first, const void* second) {
+    text_position left;
+    text_position right;
+
+    left = ((const ranked_suffix*) first)->position;
+    right = ((const ranked_suffix*) second)->position;
+
+    return (left > right) - (left < right);
+}
+
+// Compare two rank pairs by rank, and then by the rank that follows.
+static int compare_rank_pairs(const void* first, const void* second) {
+    const rank_pair* left;
+    const rank_pair* right;
+
+    left = (const rank_pair*) first;
+    right = (const rank_pair*) second;
+    if (left->rank != right->rank) {
+        return (left->rank > right->rank) - (left->rank < right->rank);
+    }
+
+    return (left->next_rank > right->next_rank) - (left->next_rank < right->next_rank);
+}
+
+// Restore the order of a heap of merge streams, whose current records are
+// kept in heads, by moving the stream at the given slot down.
+static void sift_down(
+    int* heap,
+    int heap_size,
+    int slot,
+    char* heads,
+    size_t record_size,
+    int (*compare)(const void*, const void*)
+) {
+    int child;
+    int swap;
+
+    while ((child = 2 * slot + 1) < heap_size) {
+        if (
+            child + 1 < heap_size
+            && compare(heads + heap[child + 1] * record_size, heads + heap[child] * record_size) < 0
+        ) {
+            child++;
+        }
+        if (compare(heads + heap[child] * record_size, heads + heap[slot] * record_size) >= 0) {
+            break;
+        }
+        swap = heap[slot];
+        heap[slot] = heap[child];
+        heap[child] = swap;
+        slot = child;
+    }
+}
+
+// Merge neighboring sorted runs of records from one file into a single run
+// at the same offset of another file.
+static flag merge_runs(
+    int input,
+    int output,
+    off_t start,
+    off_t end,
+    off_t run_size,
+    size_t record_size,
+    int (*compare)(const void*, const void*)
+) {
+    int run;
+    int run_count;
+    int heap_size;
+    int* heap;
+    char* heads;
+    flag result;
+    record_stream writer;
+    record_stream* readers;
+
+    run_count = (end - start + run_size - 1) / run_size;
+    heap = malloc(sizeof(int) * run_count);
+    heads = malloc(record_size * run_count);
+    readers = calloc(run_count, sizeof(record_stream));
+    if (
+        heap == NULL
+        || heads == NULL
+        || readers == NULL
+        || open_stream(&writer, output, start, end, record_size) == FLAG_FAILURE
+    ) {
+        free(readers);
+        free(heads);
+        free(heap);
+
+        return FLAG_FAILURE;
+    }
+
+    // Read the first record of every run into the heap.
+    result = FLAG_SUCCESS;
+    heap_size = 0;
+    for (run = 0; run < run_count; run++) {
+        if (
+            open_stream(
+                &readers[run],
+                input,
+                start + run * run_size,
+                (start + (run + 1) * run_size < end) ? start + (run + 1) * run_size : end,
+                record_size
+            ) == FLAG_FAILURE
+        ) {
+            result = FLAG_FAILURE;
+            break;
+        }
+        if (read_record(&readers[run], heads + run * record_size, record_size)) {
+            heap[heap_size++] = run;
+        }
+    }
+    for (run = heap_size / 2 - 1; run >= 0 && result == FLAG_SUCCESS; run--) {
+        sift_down(heap, heap_size, run, heads, record_size, compare);
+    }
+
+    // Repeatedly write out the lowest record and replace it with the next
+    // record of its run.
+    while (heap_size > 0 && result == FLAG_SUCCESS) {
+        run = heap[0];
+        result = write_record(&writer, heads + run * record_size, record_size);
+        if (!read_record(&readers[run], heads + run * record_size, record_size)) {
+            heap[0] = heap[--heap_size];
+        }
+        sift_down(heap, heap_size, 0, heads, record_size, compare);
+    }
+    if (result == FLAG_SUCCESS) {
+        result = flush_stream(&writer);
+    }
+
+    for (run = 0; run < run_count; run++) {
+        close_stream(&readers[run]);
+    }
+    close_stream(&writer);
+    free(readers);
+    free(heads);
+    free(heap);
+
+    return result;
+}
+
+// Sort the records of a file with an external merge sort. Runs that fit in
+// the memory budget are sorted in place first, and then as many runs as the
+// budget has room to buffer are merged at a time until one run is left. The
+// file is consumed, and a new file holding the sorted records is returned,
+// or -1 if something goes wrong.
+static int sort_records(
+    int file,
+    text_position count,
+    size_t record_size,
+    int (*compare)(const void*, const void*),
+    external_settings* settings
+) {
+    int output;
+    int fan_in;
+    char* buffer;
+    off_t end;
+    off_t start;
+    off_t run_size;
+    size_t length;
+    size_t transferred;
+    ssize_t bytes;
+
+    end = (off_t) count * record_size;
+    run_size = (settings->memory_budget / record_size) * record_size;
+    if ((buffer = malloc(run_size)) == NULL) {
+        close(file);
+
+        return -1;
+    }
+    for (start = 0; start < end; start += run_size) {
+        length = (start + run_size < end) ? (size_t) run_size : (size_t) (end - start);
+        for (transferred = 0; transferred < length; transferred += bytes) {
+            if ((bytes = pread(file, buffer + transferred, length - transferred, start + transferred)) <= 0) {
+                free(buffer);
+                close(file);
+
+                return -1;
+            }
+        }
+        qsort(buffer, length / record_size, record_size, compare);
+        for (transferred = 0; transferred < length; transferred += bytes) {
+            if ((bytes = pwrite(file, buffer + transferred, length - transferred, start + transferred)) <= 0) {
+                free(buffer);
+                close(file);
+
+                return -1;
+            }
+        }
+    }
+    free(buffer);
+
+    // Every run being merged needs a block, and so does the output.
+    fan_in = settings->memory_budget / EXTERNAL_BLOCK_SIZE - 1;
+    if (fan_in < 2) {
+        fan_in = 2;
+    }
+    while (run_size < end) {
+        if ((output = open_temporary(settings->directory)) < 0) {
+            close(file);
+
+            return -1;
+        }
+        for (start = 0; start < end; start += run_size * fan_in) {
+            if (
+                merge_runs(
+                    file,
+                    output,
+                    start,
+                    (start + run_size * fan_in < end) ? start + run_size * fan_in : end,
+                    run_size,
+                    record_size,
+                    compare
+                ) == FLAG_FAILURE
+            ) {
+                close(output);
+                close(file);
+
+                return -1;
+            }
+        }
+        close(file);
+        file = output;
+        run_size *= fan_in;
+    }
+
+    return file;
+}
+
+// Pair every suffix's rank with the rank of the suffix a distance after it,
+// reading the ranks, which are in position order, with two streams. Suffixes
+// that run out of characters first get a following rank of 0, so they sort
+// before the suffixes they start. Returns a new file of rank pairs.
+static int pair_ranks(int ranks, text_position count, text_position distance, external_settings* settings) {
+    int pairs;
+    flag result;
+    off_t end;
+    rank_pair pair;
+    ranked_suffix current;
+    ranked_suffix following;
+    record_stream reader;
+    record_stream ahead;
+    record_stream writer;
+
+    if ((pairs = open_temporary(settings->directory)) < 0) {
+        return -1;
+    }
+
+    end = (off_t) count * sizeof(ranked_suffix);
+    if (open_stream(&reader, ranks, 0, end, sizeof(ranked_suffix)) == FLAG_FAILURE) {
+        close(pairs);
+
+        return -1;
+    }
+    if (open_stream(&ahead, ranks, (off_t) distance * sizeof(ranked_suffix), end, sizeof(ranked_suffix)) == FLAG_FAILURE) {
+        close_stream(&reader);
+        close(pairs);
+
+        return -1;
+    }
+    if (open_stream(&writer, pairs, 0, (off_t) count * sizeof(rank_pair), sizeof(rank_pair)) == FLAG_FAILURE) {
+        close_stream(&ahead);
+        close_stream(&reader);
+        close(pairs);
+
+        return -1;
+    }
+
+    result = FLAG_SUCCESS;
+    while (result == FLAG_SUCCESS && read_record(&reader, &current, sizeof(ranked_suffix))) {
+        pair.rank = current.rank;
+        pair.next_rank = read_record(&ahead, &following, sizeof(ranked_suffix)) ? following.rank : 0;
+        pair.position = current.position;
+        result = write_record(&writer, &pair, sizeof(rank_pair));
+    }
+    if (result == FLAG_SUCCESS && writer.offset + (off_t) writer.filled != (off_t) count * (off_t) sizeof(rank_pair)) {
+        result = FLAG_FAILURE;
+    }
+    if (result == FLAG_SUCCESS) {
+        result = flush_stream(&writer);
+    }
+
+    close_stream(&writer);
+    close_stream(&ahead);
+    close_stream(&reader);
+    if (result == FLAG_FAILURE) {
+        close(pairs);
+
+        return -1;
+    }
+
+    return pairs;
+}
+
+// Give every suffix a new rank from the sorted rank pairs: one more than the
+// number of suffixes with lower pairs. Returns a new file of ranked suffixes
+// in sorted order, and saves whether every rank is now unique in unique.
+static int rerank(int pairs, text_position count, int* unique, external_settings* settings) {
+    int ranks;
+    flag result;
+    text_position index;
+    text_position groups;
+    rank_pair pair;
+    rank_pair previous;
+    ranked_suffix ranked;
+    record_stream reader;
+    record_stream writer;
+
+    if ((ranks = open_temporary(settings->directory)) < 0) {
+        return -1;
+    }
+    if (open_stream(&reader, pairs, 0, (off_t) count * sizeof(rank_pair), sizeof(rank_pair)) == FLAG_FAILURE) {
+        close(ranks);
+
+        return -1;
+    }
+    if (open_stream(&writer, ranks, 0, (off_t) count * sizeof(ranked_suffix), sizeof(ranked_suffix)) == FLAG_FAILURE) {
+        close_stream(&reader);
+        close(ranks);
+
+        return -1;
+    }
+
+    result = FLAG_SUCCESS;
+    groups = 0;
+    for (index = 0; index < count && result == FLAG_SUCCESS; index++) {
+        if (!read_record(&reader, &pair, sizeof(rank_pair))) {
+            result = FLAG_FAILURE;
+            break;
+        }
+        if (index == 0 || compare_rank_pairs(&previous, &pair) != 0) {
+            ranked.rank = index + 1;
+            groups++;
+        }
+        ranked.position = pair.position;
+        previous = pair;
+        result = write_record(&writer, &ranked, sizeof(ranked_suffix));
+    }
+    if (result == FLAG_SUCCESS) {
+        result = flush_stream(&writer);
+    }
+
+    close_stream(&writer);
+    close_stream(&reader);
+    if (result == FLAG_FAILURE) {
+        close(ranks);
+
+        return -1;
+    }
+    *unique = (groups == count);
+
+    return ranks;
+}
+
+// Stream the characters worth keeping from a file into the string section of
+// an index file, writing each one's position and byte value to a new file of
+// ranked suffixes as the first round of ranks. The bytes that appear are
+// marked in symbols, and the length of the string is saved in count.
+static int stream_string(
+    char* text_file,
+    int keep_all,
+    FILE* index,
+    unsigned char* symbols,
+    text_position* count,
+    external_settings* settings
+) {
+    int text;
+    int ranks;
+    flag result;
+    size_t kept;
+    size_t character;
+    ssize_t bytes_read;
+    char* block;
+    char* filtered;
+    ranked_suffix ranked;
+    record_stream writer;
+
+    if ((text = open(text_file, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if ((ranks = open_temporary(settings->directory)) < 0) {
+        close(text);
+
+        return -1;
+    }
+    block = malloc(sizeof(char) * EXTERNAL_BLOCK_SIZE);
+    filtered = malloc(sizeof(char) * EXTERNAL_BLOCK_SIZE);
+    if (
+        block == NULL
+        || filtered == NULL
+        || open_stream(&writer, ranks, 0, 0, sizeof(ranked_suffix)) == FLAG_FAILURE
+    ) {
+        free(filtered);
+        free(block);
+        close(ranks);
+        close(text);
+
+        return -1;
+    }
+
+    result = FLAG_SUCCESS;
+    *count = 0;
+    while (result == FLAG_SUCCESS && (bytes_read = read(text, block, EXTERNAL_BLOCK_SIZE)) > 0) {
+        kept = filter_characters(block, bytes_read, filtered, keep_all);
+        if (kept > 0 && fwrite(filtered, 1, kept, index) != kept) {
+            result = FLAG_FAILURE;
+        }
+        for (character = 0; character < kept && result == FLAG_SUCCESS; character++) {
+            if (*count >= TEXT_POSITION_MAX - 2) {
+                result = FLAG_FAILURE;
+                break;
+            }
+            symbols[(unsigned char) filtered[character]] = 1;
+            ranked.position = (*count)++;
+            ranked.rank = (unsigned char) filtered[character];
+            result = write_record(&writer, &ranked, sizeof(ranked_suffix));
+        }
+    }
+    if (bytes_read < 0) {
+        result = FLAG_FAILURE;
+    }
+    if (result == FLAG_SUCCESS) {
+        result = flush_stream(&writer);
+    }
+
+    close_stream(&writer);
+    free(filtered);
+    free(block);
+    close(text);
+    if (result == FLAG_FAILURE) {
+        close(ranks);
+
+        return -1;
+    }
+
+    return ranks;
+}
+
+// Sort every suffix by prefix doubling. Each round pairs every rank with the
+// rank a distance after it, sorts the pairs, and ranks them again, doubling
+// the distance, until every suffix has a rank of its own. Ranks are put back
+// in position order between rounds with a second sort. Returns a file of
+// ranked suffixes in sorted order.
+static int sort_suffixes_externally(int ranks, text_position count, external_settings* settings) {
+    int pairs;
+    int unique;
+    long long distance;
+    unsigned long long start_time;
+
+    // The first ranks are byte values, which sort exactly like the
+    // characters do.
+    start_time = STATS_TIME();
+    distance = 1;
+    unique = 0;
+    while (!unique) {
+        STATS_BUILD_ADD(sort_passes, 1);
+        pairs = pair_ranks(ranks, count, (distance < count) ? distance : count, settings);
+        close(ranks);
+        if (pairs < 0) {
+            return -1;
+        }
+        if ((pairs = sort_records(pairs, count, sizeof(rank_pair), compare_rank_pairs, settings)) < 0) {
+            return -1;
+        }
+        ranks = rerank(pairs, count, &unique, settings);
+        close(pairs);
+        if (ranks < 0 || unique) {
+            STATS_PHASE(PHASE_SORT, start_time);
+
+            return ranks;
+        }
+        if ((ranks = sort_records(ranks, count, sizeof(ranked_suffix), compare_positions, settings)) < 0) {
+            return -1;
+        }
+        distance *= 2;
+    }
+
+    return ranks;
+}
+
+// Build an index file from a text file without holding either the string or
+// its suffixes in memory. Unless every byte is wanted, only alphabetic
+// characters are kept, just like when reading a file normally. Sorting uses
+// about memory_budget bytes, and its temporary files are created in directory.
+// The index file can be loaded with load_suffix_array.
+flag build_external_index(
+    char* text_file,
+    char* index_file,
+    int keep_all,
+    size_t memory_budget,
+    char* directory
+) {
+    int byte;
+    int ranks;
+    int alphabet_size;
+    flag result;
+    text_position count;
+    text_position index;
+    FILE* file;
+    ranked_suffix ranked;
+    record_stream reader;
+    index_header header;
+    external_settings settings;
+    unsigned char symbols[ALPHABET_SIZE] = {0};
+
+    if (text_file == NULL || index_file == NULL) {
+        return FLAG_FAILURE;
+    }
+    settings.memory_budget = (memory_budget < EXTERNAL_MIN_MEMORY) ? EXTERNAL_MIN_MEMORY : memory_budget;
+    settings.directory = (directory == NULL) ? "/tmp" : directory;
+
+    // The string section always starts at the same offset, so it can be
+    // written before the length of the string is known.
+    if ((file = fopen(index_file, "wb")) == NULL) {
+        return FLAG_FAILURE;
+    }
+    lay_out_index(&header, 0, 0, 0, 0);
+    if (fseeko(file, header.string_offset, SEEK_SET) != 0) {
+        fclose(file);
+        remove(index_file);
+
+        return FLAG_FAILURE;
+    }
+    ranks = stream_string(text_file, keep_all, file, symbols, &count, &settings);
+    if (ranks < 0 || count == 0) {
+        if (ranks >= 0) {
+            close(ranks);
+        }
+        fclose(file);
+        remove(index_file);
+
+        return FLAG_FAILURE;
+    }
+
+    // Number the bytes that appear from 1 upwards, like build_alphabet.
+    alphabet_size = 0;
+    for (byte = 0; byte < ALPHABET_SIZE; byte++) {
+        if (symbols[byte]) {
+            symbols[byte] = ++alphabet_size;
+        }
+    }
+    lay_out_index(&header, count, alphabet_size, 0, sizeof(text_position) * count);
+
+    if ((ranks = sort_suffixes_externally(ranks, count, &settings)) < 0) {
+        fclose(file);
+        remove(index_file);
+
+        return FLAG_FAILURE;
+    }
+
+    // Finish the string, then write the suffixes in sorted order, and
+    // finally go back for the header and the alphabet.
+    result = (
+        fputc('\0', file) != EOF
+        && pad_index_section(file, count + 1) == FLAG_SUCCESS
+        && open_stream(&reader, ranks, 0, (off_t) count * sizeof(ranked_suffix), sizeof(ranked_suffix)) == FLAG_SUCCESS
+    ) ? FLAG_SUCCESS : FLAG_FAILURE;
+    if (result == FLAG_SUCCESS) {
+        for (index = 0; index < count && result == FLAG_SUCCESS; index++) {
+            if (
+                !read_record(&reader, &ranked, sizeof(ranked_suffix))
+                || fwrite(&ranked.position, sizeof(text_position), 1, file) != 1
+            ) {
+                result = FLAG_FAILURE;
+            }
+        }
+        close_stream(&reader);
+    }
+    close(ranks);
+    if (
+        result == FLAG_FAILURE
+        || pad_index_section(file, sizeof(text_position) * count) == FLAG_FAILURE
+        || fseeko(file, 0, SEEK_SET) != 0
+        || fwrite(&header, sizeof(index_header), 1, file) != 1
+        || fseeko(file, header.alphabet_offset, SEEK_SET) != 0
+        || fwrite(symbols, sizeof(symbols), 1, file) != 1
+    ) {
+        fclose(file);
+        remove(index_file);
+
+        return FLAG_FAILURE;
+    }
+
+    if (fclose(file) != 0) {
+        remove(index_file);
+
+        return FLAG_FAILURE;
+    }
+
+    return FLAG_SUCCESS;
+}
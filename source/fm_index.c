@@ -0,0 +1,429 @@
+// Provides an FM-index, a compressed stand-in for a suffix array built from
+// the Burrows-Wheeler transform of its string. Counting a pattern takes two
+// rank queries per character, and locating an occurrence walks backwards
+// through the string until it reaches a sampled position.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "suffix_array.h"
+
+// Create an empty rank bit vector that can hold the given number of bits.
+// There is always one spare word and block, so ranking the very end of the
+// bit vector never reads past it.
+static flag new_rank_bitvector(rank_bitvector* bits, text_position length) {
+    text_position word_count;
+
+    word_count = length / 64 + 1;
+    bits->length = length;
+    bits->words = calloc(word_count, sizeof(unsigned long long));
+    bits->block_ranks = malloc(sizeof(text_position) * (word_count / RANK_BLOCK_WORDS + 1));
+
+    return (bits->words == NULL || bits->block_ranks == NULL) ? FLAG_FAILURE : FLAG_SUCCESS;
+}
+
+// Set a bit in a rank bit vector.
+static void set_bit(rank_bitvector* bits, text_position index) {
+    bits->words[index / 64] |= 1ULL << (index % 64);
+}
+
+// Get a bit from a rank bit vector.
+static int bit_at(rank_bitvector* bits, text_position index) {
+    return (bits->words[index / 64] >> (index % 64)) & 1;
+}
+
+// Count the set bits before every block of a rank bit vector. This must be
+// done once every bit has been set.
+static void count_block_ranks(rank_bitvector* bits) {
+    text_position sum;
+    text_position word;
+
+    sum = 0;
+    for (word = 0; word <= bits->length / 64; word++) {
+        if (word % RANK_BLOCK_WORDS == 0) {
+            bits->block_ranks[word / RANK_BLOCK_WORDS] = sum;
+        }
+        sum += __builtin_popcountll(bits->words[word]);
+    }
+}
+
+// Count the set bits of a rank bit vector before an index.
+static text_position rank_ones(rank_bitvector* bits, text_position index) {
+    text_position word;
+    text_position last_word;
+    text_position count;
+
+    last_word = index / 64;
+    count = bits->block_ranks[last_word / RANK_BLOCK_WORDS];
+    for (word = last_word - last_word % RANK_BLOCK_WORDS; word < last_word; word++) {
+        count += __builtin_popcountll(bits->words[word]);
+    }
+    if (index % 64 != 0) {
+        count += __builtin_popcountll(bits->words[last_word] & ((1ULL << (index % 64)) - 1));
+    }
+
+    return count;
+}
+
+// Store a value in an array of zeroed, bit packed values, in the layout
+// that bit_packed_value reads.
+static void set_packed_value(unsigned char* values, text_position index, int bits, text_position value) {
+    size_t offset;
+
+    offset = (size_t) index * bits;
+    for (; bits > 0; bits--, offset++, value >>= 1) {
+        values[offset / 8] |= (unsigned char) ((value & 1) << (offset % 8));
+    }
+}
+
+// Destroy the contents of a rank bit vector.
+static void destroy_rank_bitvector(rank_bitvector* bits) {
+    free(bits->words);
+    free(bits->block_ranks);
+    bits->words = NULL;
+    bits->block_ranks = NULL;
+}
+
+// Follow a row of the transform down through every level of the wavelet
+// matrix, as if it held the given symbol, and return where it ends up.
+// Rows of the same symbol end up next to each other, in their original order.
+static text_position descend(fm_index* index, int symbol, text_position row) {
+    int level;
+    text_position ones;
+
+    for (level = 0; level < index->level_count; level++) {
+        ones = rank_ones(&index->levels[level], row);
+        if ((symbol >> (index->level_count - 1 - level)) & 1) {
+            row = index->level_zeros[level] + ones;
+        }
+        else {
+            row -= ones;
+        }
+    }
+
+    return row;
+}
+
+// Count the occurrences of a symbol in the transform before a row.
+static text_position rank_symbol(fm_index* index, int symbol, text_position row) {
+    return descend(index, symbol, row) - index->symbol_starts[symbol];
+}
+
+// Map a row of the transform to the row of the suffix that starts one
+// character earlier in the string, and return the symbol that was read.
+static int last_to_first(fm_index* index, text_position* row) {
+    int bit;
+    int level;
+    int symbol;
+    text_position ones;
+    text_position position;
+
+    symbol = 0;
+    position = *row;
+    for (level = 0; level < index->level_count; level++) {
+        bit = bit_at(&index->levels[level], position);
+        ones = rank_ones(&index->levels[level], position);
+        symbol = (symbol << 1) | bit;
+        position = (bit) ? index->level_zeros[level] + ones : position - ones;
+    }
+    *row = index->counts[symbol] + position - index->symbol_starts[symbol];
+
+    return symbol;
+}
+
+// Store the transform in a wavelet matrix. Each level records one bit of
+// every symbol, from the highest bit down, and then stably moves the symbols
+// with a 0 bit ahead of those with a 1 bit for the next level. The transform
+// is freed either way.
+static flag build_wavelet_matrix(fm_index* index, unsigned char* transform, text_position rows) {
+    int level;
+    int shift;
+    text_position row;
+    text_position zeros;
+    text_position ones;
+    unsigned char* next;
+    unsigned char* swap;
+
+    if ((next = malloc(sizeof(unsigned char) * rows)) == NULL) {
+        free(transform);
+
+        return FLAG_FAILURE;
+    }
+
+    for (level = 0; level < index->level_count; level++) {
+        if (new_rank_bitvector(&index->levels[level], rows) == FLAG_FAILURE) {
+            free(transform);
+            free(next);
+
+            return FLAG_FAILURE;
+        }
+
+        shift = index->level_count - 1 - level;
+        zeros = 0;
+        for (row = 0; row < rows; row++) {
+            if ((transform[row] >> shift) & 1) {
+                set_bit(&index->levels[level], row);
+            }
+            else {
+                zeros++;
+            }
+        }
+        count_block_ranks(&index->levels[level]);
+        index->level_zeros[level] = zeros;
+
+        ones = zeros;
+        zeros = 0;
+        for (row = 0; row < rows; row++) {
+            if ((transform[row] >> shift) & 1) {
+                next[ones++] = transform[row];
+            }
+            else {
+                next[zeros++] = transform[row];
+            }
+        }
+        swap = transform;
+        transform = next;
+        next = swap;
+    }
+
+    free(transform);
+    free(next);
+
+    return FLAG_SUCCESS;
+}
+
+// Create an FM-index from a suffix array, remembering the position of every
+// row whose position is a multiple of the sample rate. Lower rates locate
+// occurrences faster at the cost of more memory. The suffix array is left
+// untouched and can be destroyed afterwards.
+fm_index* new_fm_index(suffix_array* array, text_position sample_rate) {
+    int symbol;
+    text_position row;
+    text_position rows;
+    text_position sum;
+    text_position suffix;
+    text_position sample_count;
+    unsigned long long start_time;
+    unsigned char* transform;
+    fm_index* index;
+
+    if (array == NULL || sample_rate < 1) {
+        return NULL;
+    }
+    start_time = STATS_TIME();
+
+    if ((index = calloc(1, sizeof(fm_index))) == NULL) {
+        return NULL;
+    }
+    rows = array->string_length + 1;
+    index->string_length = array->string_length;
+    index->sample_rate = sample_rate;
+    index->alphabet_size = array->alphabet_size;
+    memcpy(index->symbols, array->symbols, sizeof(index->symbols));
+
+    // The sentinel takes symbol 0, so the matrix needs enough levels
+    // for every symbol from 0 up to the alphabet size.
+    while ((1 << index->level_count) <= index->alphabet_size) {
+        index->level_count++;
+    }
+
+    if ((transform = malloc(sizeof(unsigned char) * rows)) == NULL) {
+        destroy_fm_index(index);
+
+        return NULL;
+    }
+    if (new_rank_bitvector(&index->sampled_rows, rows) == FLAG_FAILURE) {
+        free(transform);
+        destroy_fm_index(index);
+
+        return NULL;
+    }
+
+    // Every row of the transform holds the symbol before its suffix. The
+    // sentinel's suffix sorts first, and the whole string is preceded by the
+    // sentinel itself. Mark the rows that will keep their positions.
+    transform[0] = array->symbols[(unsigned char) array->string[array->string_length - 1]];
+    if (array->string_length % sample_rate == 0) {
+        set_bit(&index->sampled_rows, 0);
+    }
+    for (row = 1; row < rows; row++) {
+        suffix = suffix_at(array, row - 1);
+        transform[row] = (suffix == 0) ? 0 : array->symbols[(unsigned char) array->string[suffix - 1]];
+        if (suffix % sample_rate == 0) {
+            set_bit(&index->sampled_rows, row);
+        }
+    }
+    count_block_ranks(&index->sampled_rows);
+
+    // Save the sampled positions in row order. Every one of them is a
+    // multiple of the rate, so only the quotient is kept.
+    sample_count = rank_ones(&index->sampled_rows, rows);
+    index->sample_bits = bits_needed(array->string_length / sample_rate + 1);
+    index->samples = calloc(bit_packed_size(sample_count, index->sample_bits), sizeof(unsigned char));
+    if (index->samples == NULL) {
+        free(transform);
+        destroy_fm_index(index);
+
+        return NULL;
+    }
+    sample_count = 0;
+    for (row = 0; row < rows; row++) {
+        if (bit_at(&index->sampled_rows, row)) {
+            suffix = (row == 0) ? array->string_length : suffix_at(array, row - 1);
+            set_packed_value(index->samples, sample_count++, index->sample_bits, suffix / sample_rate);
+        }
+    }
+
+    // Count how many symbols sort before each symbol.
+    for (row = 0; row < rows; row++) {
+        index->counts[transform[row]]++;
+    }
+    sum = 0;
+    for (symbol = 0; symbol <= index->alphabet_size; symbol++) {
+        sum += index->counts[symbol];
+        index->counts[symbol] = sum - index->counts[symbol];
+    }
+
+    if (build_wavelet_matrix(index, transform, rows) == FLAG_FAILURE) {
+        destroy_fm_index(index);
+
+        return NULL;
+    }
+
+    // Every symbol's rows start wherever row 0 ends up.
+    for (symbol = 0; symbol <= index->alphabet_size; symbol++) {
+        index->symbol_starts[symbol] = descend(index, symbol, 0);
+    }
+    STATS_PHASE(PHASE_FM_INDEX, start_time);
+
+    return index;
+}
+
+// Find the range of sorted suffixes that start with a pattern, matching the
+// pattern from its last character to its first. The range uses the same
+// indices as search_range does on the original suffix array.
+flag fm_search_range(fm_index* index, char* pattern, suffix_range* range) {
+    int symbol;
+    text_position low;
+    text_position high;
+    text_position character;
+    unsigned long long start_time;
+
+    if (index == NULL || pattern == NULL || pattern[0] == '\0' || range == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    start_time = STATS_TIME();
+    low = 0;
+    high = index->string_length + 1;
+    character = strlen(pattern) - 1;
+    while (character >= 0 && low < high) {
+        STATS_SEARCH_ADD(probes, 1);
+        if ((symbol = index->symbols[(unsigned char) pattern[character]]) == 0) {
+            low = high;
+            break;
+        }
+        low = index->counts[symbol] + rank_symbol(index, symbol, low);
+        high = index->counts[symbol] + rank_symbol(index, symbol, high);
+        character--;
+    }
+
+    // Shift the rows past the sentinel's row.
+    if (low < high) {
+        range->low = low - 1;
+        range->high = high - 1;
+    }
+    else {
+        range->low = 0;
+        range->high = 0;
+    }
+    STATS_SEARCH(start_time);
+
+    return FLAG_SUCCESS;
+}
+
+// Count the number of times a pattern appears in the string.
+text_position fm_count_occurrences(fm_index* index, char* pattern) {
+    suffix_range range;
+
+    if (fm_search_range(index, pattern, &range) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
+    }
+
+    return range.high - range.low;
+}
+
+// Retrieve the starting position of the suffix at an index of the sorted
+// suffixes. Each step back through the string is one character closer to
+// a sampled position, which is at most sample_rate - 1 steps away.
+text_position fm_locate(fm_index* index, text_position suffix_index) {
+    text_position row;
+    text_position steps;
+
+    if (index == NULL || suffix_index < 0 || suffix_index >= index->string_length) {
+        return FLAG_FAILURE;
+    }
+
+    row = suffix_index + 1;
+    steps = 0;
+    while (!bit_at(&index->sampled_rows, row)) {
+        last_to_first(index, &row);
+        steps++;
+    }
+
+    return bit_packed_value(
+        index->samples,
+        rank_ones(&index->sampled_rows, row),
+        index->sample_bits
+    ) * index->sample_rate + steps;
+}
+
+// Retrieve the next position in a range of sorted suffixes, shrinking the range.
+// The positions come out in sorted suffix order, not string order.
+text_position fm_next_occurrence(fm_index* index, suffix_range* range) {
+
+    if (index == NULL || range == NULL || range->low >= range->high) {
+        return FLAG_FAILURE;
+    }
+
+    return fm_locate(index, range->low++);
+}
+
+// Determine how many bytes an FM-index occupies.
+size_t fm_index_size(fm_index* index) {
+    int level;
+    size_t words;
+    size_t size;
+
+    if (index == NULL) {
+        return 0;
+    }
+
+    // Every bit vector has the same number of bits, one per row.
+    words = index->string_length / 64 + 2;
+    size = sizeof(fm_index);
+    for (level = 0; level <= index->level_count; level++) {
+        size += sizeof(unsigned long long) * words;
+        size += sizeof(text_position) * (words / RANK_BLOCK_WORDS + 1);
+    }
+    size += bit_packed_size(index->string_length / index->sample_rate + 1, index->sample_bits);
+
+    return size;
+}
+
+// Destroy an FM-index.
+void destroy_fm_index(fm_index* index) {
+    int level;
+
+    if (index == NULL) {
+        return;
+    }
+
+    for (level = 0; level < FM_MAX_LEVELS; level++) {
+        destroy_rank_bitvector(&index->levels[level]);
+    }
+    destroy_rank_bitvector(&index->sampled_rows);
+    free(index->samples);
+    free(index);
+}
@@ -0,0 +1,271 @@
+// Saves suffix arrays to versioned binary index files, and loads them back
+// by memory mapping the file so that nothing is copied or re-sorted.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "suffix_array.h"
+
+// Round a section size up so the next section stays aligned.
+static size_t align_section(size_t size) {
+    return (size + INDEX_ALIGNMENT - 1) & ~((size_t) INDEX_ALIGNMENT - 1);
+}
+
+// Write enough padding after a section of the given size to align the next
+// section.
+flag pad_index_section(FILE* file, size_t size) {
+    size_t padding;
+    char zeroes[INDEX_ALIGNMENT] = {0};
+
+    padding = align_section(size) - size;
+    if (padding > 0 && fwrite(zeroes, 1, padding, file) != padding) {
+        return FLAG_FAILURE;
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Write a section of an index file, followed by enough padding to align
+// the next section.
+static flag write_section(FILE* file, void* data, size_t size) {
+
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return FLAG_FAILURE;
+    }
+
+    return pad_index_section(file, size);
+}
+
+// Fill in an index header for a string of the given length, laying out every
+// section back to back after it. The string keeps its null terminator so it
+// can be used in place after loading. The LCP tables are only laid out if
+// the flags say there are some.
+void lay_out_index(
+    index_header* header,
+    text_position string_length,
+    int alphabet_size,
+    unsigned int flags,
+    size_t suffixes_size
+) {
+    size_t offset;
+    size_t integers_size;
+
+    integers_size = sizeof(text_position) * string_length;
+    memset(header, 0, sizeof(index_header));
+    memcpy(header->magic, INDEX_MAGIC, sizeof(header->magic));
+    header->version = INDEX_VERSION;
+    header->flags = flags;
+    header->integer_size = sizeof(text_position);
+    header->string_length = string_length;
+    header->alphabet_size = alphabet_size;
+    offset = align_section(sizeof(index_header));
+    header->alphabet_offset = offset;
+    offset += align_section(ALPHABET_SIZE);
+    header->string_offset = offset;
+    offset += align_section(sizeof(char) * (string_length + 1));
+    header->suffixes_offset = offset;
+    offset += align_section(suffixes_size);
+    if (flags & INDEX_HAS_LCP) {
+        header->lcp_offset = offset;
+        offset += align_section(integers_size);
+        header->left_lcp_offset = offset;
+        offset += align_section(integers_size);
+        header->right_lcp_offset = offset;
+        offset += align_section(integers_size);
+    }
+    header->file_size = offset;
+}
+
+// Save a suffix array, and its LCP tables if it has them, to an index file.
+flag save_suffix_array(suffix_array* array, char* file_name) {
+    FILE* file;
+    unsigned int flags;
+    size_t string_size;
+    size_t suffixes_size;
+    size_t integers_size;
+    index_header header;
+
+    if (array == NULL || file_name == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    string_size = sizeof(char) * (array->string_length + 1);
+    integers_size = sizeof(text_position) * array->string_length;
+    suffixes_size = integers_size;
+    flags = 0;
+    if (array->suffix_bits != 0) {
+        flags |= INDEX_BIT_PACKED_SUFFIXES;
+        suffixes_size = bit_packed_size(array->string_length, array->suffix_bits);
+    }
+    else if (array->packed_suffixes != NULL) {
+        flags |= INDEX_PACKED_SUFFIXES;
+        suffixes_size = (size_t) array->string_length * PACKED_SUFFIX_SIZE;
+    }
+    if (array->lcp != NULL) {
+        flags |= INDEX_HAS_LCP;
+    }
+    lay_out_index(&header, array->string_length, array->alphabet_size, flags, suffixes_size);
+
+    if ((file = fopen(file_name, "wb")) == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    // Write the sections in the same order they were laid out. The string's
+    // null terminator is written on its own, since a borrowed string may not
+    // have one.
+    if (
+        write_section(file, &header, sizeof(index_header)) == FLAG_FAILURE
+        || write_section(file, array->symbols, sizeof(array->symbols)) == FLAG_FAILURE
+        || fwrite(array->string, sizeof(char), array->string_length, file) != (size_t) array->string_length
+        || fputc('\0', file) == EOF
+        || pad_index_section(file, string_size) == FLAG_FAILURE
+        || write_section(
+            file,
+            (array->packed_suffixes != NULL) ? (void*) array->packed_suffixes : (void*) array->suffixes,
+            suffixes_size
+        ) == FLAG_FAILURE
+        || (
+            array->lcp != NULL
+            && (
+                write_section(file, array->lcp, integers_size) == FLAG_FAILURE
+                || write_section(file, array->left_lcp, integers_size) == FLAG_FAILURE
+                || write_section(file, array->right_lcp, integers_size) == FLAG_FAILURE
+            )
+        )
+    ) {
+        fclose(file);
+        remove(file_name);
+
+        return FLAG_FAILURE;
+    }
+
+    if (fclose(file) != 0) {
+        remove(file_name);
+
+        return FLAG_FAILURE;
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Determine if a section of the given size fits inside a mapped index file.
+static int section_fits(index_header* header, size_t offset, size_t size) {
+    return (
+        offset % INDEX_ALIGNMENT == 0
+        && offset <= header->file_size
+        && size <= header->file_size - offset
+    );
+}
+
+// Load a suffix array from an index file. The file is mapped read-only and
+// shared, so loading is instant and processes that load the same index share
+// its pages. The returned suffix array must not be modified.
+suffix_array* load_suffix_array(char* file_name) {
+    int file;
+    int suffix_bits;
+    char* mapping;
+    size_t suffixes_size;
+    size_t integers_size;
+    struct stat status;
+    index_header* header;
+    suffix_array* array;
+
+    if (file_name == NULL) {
+        return NULL;
+    }
+
+    if ((file = open(file_name, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(file, &status) != 0 || (size_t) status.st_size < sizeof(index_header)) {
+        close(file);
+
+        return NULL;
+    }
+
+    // The mapping stays valid after the file is closed.
+    mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Refuse anything that isn't an index file written by a compatible
+    // version on a machine with the same integer size. Bit packed suffixes
+    // always use as few bits as the string length allows.
+    header = (index_header*) mapping;
+    integers_size = sizeof(text_position) * header->string_length;
+    suffix_bits = bits_needed(header->string_length);
+    if (header->flags & INDEX_BIT_PACKED_SUFFIXES) {
+        suffixes_size = bit_packed_size(header->string_length, suffix_bits);
+    }
+    else if (header->flags & INDEX_PACKED_SUFFIXES) {
+        suffixes_size = PACKED_SUFFIX_SIZE * header->string_length;
+    }
+    else {
+        suffixes_size = integers_size;
+    }
+    if (
+        memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0
+        || header->version < INDEX_OLDEST_VERSION
+        || header->version > INDEX_VERSION
+        || header->integer_size != sizeof(text_position)
+        || header->file_size != (unsigned long long) status.st_size
+        || header->string_length < 1
+        || header->string_length >= TEXT_POSITION_MAX
+        || header->alphabet_size < 1
+        || header->alphabet_size >= ALPHABET_SIZE
+        || !section_fits(header, header->alphabet_offset, ALPHABET_SIZE)
+        || !section_fits(header, header->string_offset, header->string_length + 1)
+        || mapping[header->string_offset + header->string_length] != '\0'
+        || !section_fits(header, header->suffixes_offset, suffixes_size)
+        || (
+            (header->flags & INDEX_HAS_LCP)
+            && (
+                !section_fits(header, header->lcp_offset, integers_size)
+                || !section_fits(header, header->left_lcp_offset, integers_size)
+                || !section_fits(header, header->right_lcp_offset, integers_size)
+            )
+        )
+    ) {
+        munmap(mapping, status.st_size);
+
+        return NULL;
+    }
+
+    if ((array = calloc(1, sizeof(suffix_array))) == NULL) {
+        munmap(mapping, status.st_size);
+
+        return NULL;
+    }
+
+    // Point the suffix array straight into the mapped sections.
+    array->mapping = mapping;
+    array->mapping_size = status.st_size;
+    array->string_length = header->string_length;
+    array->string = mapping + header->string_offset;
+    array->alphabet_size = header->alphabet_size;
+    memcpy(array->symbols, mapping + header->alphabet_offset, sizeof(array->symbols));
+    if (header->flags & INDEX_BIT_PACKED_SUFFIXES) {
+        array->packed_suffixes = (unsigned char*) (mapping + header->suffixes_offset);
+        array->suffix_bits = suffix_bits;
+    }
+    else if (header->flags & INDEX_PACKED_SUFFIXES) {
+        array->packed_suffixes = (unsigned char*) (mapping + header->suffixes_offset);
+    }
+    else {
+        array->suffixes = (text_position*) (mapping + header->suffixes_offset);
+    }
+    if (header->flags & INDEX_HAS_LCP) {
+        array->lcp = (text_position*) (mapping + header->lcp_offset);
+        array->left_lcp = (text_position*) (mapping + header->left_lcp_offset);
+        array->right_lcp = (text_position*) (mapping + header->right_lcp_offset);
+    }
+
+    return array;
+}
@@ -0,0 +1,222 @@
+// Provides linear-time suffix sorting using the induced sorting (SA-IS)
+// algorithm described by Nong, Zhang, and Chan.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "suffix_array.h"
+
+#define TYPE_L 0
+#define TYPE_S 1
+
+// Determine if the position is the leftmost S-type position of a run.
+static int is_leftmost_s(unsigned char* types, text_position position) {
+    return (position > 0 && types[position] == TYPE_S && types[position - 1] == TYPE_L);
+}
+
+// Find the start (or end, if requested) of every symbol's bucket.
+static void find_buckets(
+    text_position* text,
+    text_position length,
+    text_position* buckets,
+    text_position alphabet_size,
+    int ends
+) {
+    text_position sum;
+    text_position symbol;
+    text_position position;
+
+    for (symbol = 0; symbol < alphabet_size; symbol++) {
+        buckets[symbol] = 0;
+    }
+    for (position = 0; position < length; position++) {
+        buckets[text[position]]++;
+    }
+
+    // Convert the symbol counts into bucket boundaries.
+    sum = 0;
+    for (symbol = 0; symbol < alphabet_size; symbol++) {
+        sum += buckets[symbol];
+        buckets[symbol] = (ends) ? sum : sum - buckets[symbol];
+    }
+}
+
+// Induce the order of L-type and then S-type suffixes from the suffixes
+// already placed in the array.
+static void induce_suffixes(
+    text_position* text,
+    text_position* suffixes,
+    unsigned char* types,
+    text_position* buckets,
+    text_position length,
+    text_position alphabet_size
+) {
+    text_position index;
+    text_position previous;
+
+    // Scan left to right, placing each L-type predecessor at the front of its bucket.
+    find_buckets(text, length, buckets, alphabet_size, 0);
+    for (index = 0; index < length; index++) {
+        previous = suffixes[index] - 1;
+        if (suffixes[index] > 0 && types[previous] == TYPE_L) {
+            suffixes[buckets[text[previous]]++] = previous;
+        }
+    }
+
+    // Scan right to left, placing each S-type predecessor at the back of its bucket.
+    find_buckets(text, length, buckets, alphabet_size, 1);
+    for (index = length - 1; index >= 0; index--) {
+        previous = suffixes[index] - 1;
+        if (suffixes[index] > 0 && types[previous] == TYPE_S) {
+            suffixes[--buckets[text[previous]]] = previous;
+        }
+    }
+}
+
+// Sort all suffixes of a text whose final symbol is a unique 0 sentinel and
+// whose symbols all lie in [0, alphabet_size).
+flag induced_sort(
+    text_position* text,
+    text_position* suffixes,
+    text_position length,
+    text_position alphabet_size
+) {
+    text_position name;
+    text_position index;
+    text_position offset;
+    text_position current;
+    text_position previous;
+    text_position lms_count;
+    text_position* buckets;
+    text_position* reduced_text;
+    int different;
+    unsigned char* types;
+
+    if ((types = malloc(sizeof(unsigned char) * length)) == NULL) {
+        return FLAG_FAILURE;
+    }
+    if ((buckets = malloc(sizeof(text_position) * alphabet_size)) == NULL) {
+        free(types);
+
+        return FLAG_FAILURE;
+    }
+    STATS_BUILD_ADD(bucket_allocations, 2);
+    STATS_BUILD_ADD(sort_passes, 1);
+
+    // Classify every position as L-type or S-type, moving right to left.
+    types[length - 1] = TYPE_S;
+    for (index = length - 2; index >= 0; index--) {
+        types[index] = (
+            text[index] < text[index + 1]
+            || (text[index] == text[index + 1] && types[index + 1] == TYPE_S)
+        ) ? TYPE_S : TYPE_L;
+    }
+
+    // Drop every LMS position at the back of its bucket, then induce the
+    // rest. This sorts all LMS substrings.
+    find_buckets(text, length, buckets, alphabet_size, 1);
+    for (index = 0; index < length; index++) {
+        suffixes[index] = -1;
+    }
+    for (index = 1; index < length; index++) {
+        if (is_leftmost_s(types, index)) {
+            suffixes[--buckets[text[index]]] = index;
+        }
+    }
+    induce_suffixes(text, suffixes, types, buckets, length, alphabet_size);
+
+    // Gather the sorted LMS substrings at the front of the suffix array.
+    lms_count = 0;
+    for (index = 0; index < length; index++) {
+        if (is_leftmost_s(types, suffixes[index])) {
+            suffixes[lms_count++] = suffixes[index];
+        }
+    }
+
+    // Name each LMS substring by rank. Equal substrings share a name. Names
+    // are stored in the back half of the array, which is free at this point
+    // because no two LMS positions are adjacent.
+    for (index = lms_count; index < length; index++) {
+        suffixes[index] = -1;
+    }
+    name = 0;
+    previous = -1;
+    for (index = 0; index < lms_count; index++) {
+        current = suffixes[index];
+        different = 0;
+        for (offset = 0; offset < length; offset++) {
+            if (
+                previous == -1
+                || text[current + offset] != text[previous + offset]
+                || types[current + offset] != types[previous + offset]
+            ) {
+                different = 1;
+                break;
+            }
+            else if (
+                offset > 0
+                && (is_leftmost_s(types, current + offset) || is_leftmost_s(types, previous + offset))
+            ) {
+                break;
+            }
+        }
+        if (different) {
+            name++;
+            previous = current;
+        }
+        suffixes[lms_count + current / 2] = name - 1;
+    }
+
+    // Pack the names to the very end of the array to form the reduced text.
+    offset = length - 1;
+    for (index = length - 1; index >= lms_count; index--) {
+        if (suffixes[index] >= 0) {
+            suffixes[offset--] = suffixes[index];
+        }
+    }
+    reduced_text = suffixes + length - lms_count;
+
+    // If any names repeat, the LMS suffixes must be sorted recursively.
+    // Otherwise their order follows directly from the names.
+    if (name < lms_count) {
+        if (induced_sort(reduced_text, suffixes, lms_count, name) == FLAG_FAILURE) {
+            free(buckets);
+            free(types);
+
+            return FLAG_FAILURE;
+        }
+    }
+    else {
+        for (index = 0; index < lms_count; index++) {
+            suffixes[reduced_text[index]] = index;
+        }
+    }
+
+    // Translate the sorted reduced suffixes back into LMS positions.
+    offset = 0;
+    for (index = 1; index < length; index++) {
+        if (is_leftmost_s(types, index)) {
+            reduced_text[offset++] = index;
+        }
+    }
+    for (index = 0; index < lms_count; index++) {
+        suffixes[index] = reduced_text[suffixes[index]];
+    }
+
+    // Seed the buckets with the sorted LMS suffixes and induce the final order.
+    for (index = lms_count; index < length; index++) {
+        suffixes[index] = -1;
+    }
+    find_buckets(text, length, buckets, alphabet_size, 1);
+    for (index = lms_count - 1; index >= 0; index--) {
+        current = suffixes[index];
+        suffixes[index] = -1;
+        suffixes[--buckets[text[current]]] = current;
+    }
+    induce_suffixes(text, suffixes, types, buckets, length, alphabet_size);
+
+    free(buckets);
+    free(types);
+
+    return FLAG_SUCCESS;
+}
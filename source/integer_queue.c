@@ -1,91 +1,99 @@
-// Provides an integer queue built using a linked list. Includes
-// all typical queue functions and can be any size.
+// Provides an integer queue built on a growable ring buffer. Includes
+// all typical queue functions and can be any size. Every integer lives in
+// one contiguous buffer, so enqueueing and dequeueing never allocate once
+// the queue has grown to its working size.
 // Written by Tiger Sachse.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "suffix_array.h"
 
 // Create a new, empty integer queue.
 integer_queue* new_integer_queue(void) {
-    return calloc(1, sizeof(integer_queue));
-}
+    integer_queue* queue;
 
-// Create a new node with the provided data for an integer queue.
-integer_queue_node* new_integer_queue_node(int data) {
-    integer_queue_node* new_node;
+    if ((queue = calloc(1, sizeof(integer_queue))) == NULL) {
+        return NULL;
+    }
+    if ((queue->data = malloc(sizeof(text_position) * INTEGER_QUEUE_CAPACITY)) == NULL) {
+        free(queue);
 
-    if ((new_node = malloc(sizeof(integer_queue_node))) == NULL) {
         return NULL;
     }
-    else {
-        new_node->data = data;
-        new_node->next = NULL;
+    queue->capacity = INTEGER_QUEUE_CAPACITY;
+    STATS_BUILD_ADD(queue_allocations, 1);
+
+    return queue;
+}
 
-        return new_node;
+// Double the capacity of a full queue. The integers are unwrapped into
+// the new buffer, so the front of the queue ends up at its start.
+static flag grow_integer_queue(integer_queue* queue) {
+    text_position front;
+    text_position* data;
+
+    if ((data = malloc(sizeof(text_position) * 2 * queue->capacity)) == NULL) {
+        return FLAG_FAILURE;
     }
+
+    front = queue->capacity - queue->head;
+    memcpy(data, queue->data + queue->head, sizeof(text_position) * front);
+    memcpy(data + front, queue->data, sizeof(text_position) * queue->head);
+    STATS_BUILD_ADD(queue_allocations, 1);
+    free(queue->data);
+    queue->data = data;
+    queue->head = 0;
+    queue->capacity *= 2;
+
+    return FLAG_SUCCESS;
 }
 
 // Determine if the queue is empty.
 int is_empty(integer_queue* queue) {
-    return (queue == NULL || queue->head == NULL);
+    return (queue == NULL || queue->size == 0);
 }
 
 // Add a new integer to the queue.
-flag enqueue(integer_queue* queue, int data) {
+flag enqueue(integer_queue* queue, text_position data) {
     if (queue == NULL) {
         return FLAG_FAILURE;
     }
 
-    // If the queue is empty, insert a new node at the head of the queue.
-    if (is_empty(queue)) {
-        if ((queue->head = new_integer_queue_node(data)) == NULL) {
-            return FLAG_FAILURE;
-        }
-
-        queue->tail = queue->head;
+    // Make room if the buffer is full. The capacity is always a power of
+    // two, so positions wrap around with a mask.
+    if (queue->size == queue->capacity && grow_integer_queue(queue) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
     }
 
-    // Otherwise, insert a new node at the back of the queue.
-    else {
-        if ((queue->tail->next = new_integer_queue_node(data)) == NULL) {
-            return FLAG_FAILURE;
-        }
-
-        queue->tail = queue->tail->next;
-    }
+    queue->data[(queue->head + queue->size) & (queue->capacity - 1)] = data;
+    queue->size++;
 
     return FLAG_SUCCESS;
 }
 
 // Retrieve the data at the front of the queue.
-int dequeue(integer_queue* queue) {
-    int dequeued_data;
-    integer_queue_node* dequeued_node;
+text_position dequeue(integer_queue* queue) {
+    text_position dequeued_data;
 
     if (is_empty(queue)) {
         return FLAG_FAILURE;
     }
 
-    // Save the dequeued node and advance the head pointer.
-    // If head becomes NULL then the end of the queue has been reached,
-    // so tail must also be set to NULL.
-    dequeued_node = queue->head;
-    queue->head = queue->head->next;
-    if (queue->head == NULL) {
-        queue->tail = NULL;
+    // Advance the head. Once the queue empties, start over at the front of
+    // the buffer so the next round of integers is written in order.
+    dequeued_data = queue->data[queue->head];
+    queue->head = (queue->head + 1) & (queue->capacity - 1);
+    if (--queue->size == 0) {
+        queue->head = 0;
     }
 
-    // Free the dequeued node and return its value.
-    dequeued_data = dequeued_node->data;
-    free(dequeued_node);
-
     return dequeued_data;
 }
 
 // Print the entire integer queue.
 void print_integer_queue(integer_queue* queue) {
-    integer_queue_node* current_node;
+    text_position index;
 
     if (queue == NULL) {
         printf("Queue is NULL!\n");
@@ -99,29 +107,24 @@ void print_integer_queue(integer_queue* queue) {
         return;
     }
 
-    // Iterate through the queue and print every node's data.
-    current_node = queue->head;
-    while (current_node != NULL) {
-        printf("%d%s", current_node->data, (current_node->next == NULL) ? "\n" : " ");
-        current_node = current_node->next;
+    // Print every integer from the front of the queue to the back.
+    for (index = 0; index < queue->size; index++) {
+        printf(
+            TEXT_POSITION_FORMAT "%s",
+            queue->data[(queue->head + index) & (queue->capacity - 1)],
+            (index + 1 == queue->size) ? "\n" : " "
+        );
     }
 }
 
 // Destroy an integer queue in memory.
 void destroy_integer_queue(integer_queue* queue) {
-    integer_queue_node* next_node;
 
     if (queue == NULL) {
         return;
     }
 
-    // Destroy all the nodes in the queue's linked list.
-    while (queue->head != NULL) {
-        next_node = queue->head->next;
-        free(queue->head);
-        queue->head = next_node;
-    }
-
+    free(queue->data);
     free(queue);
 }
 
@@ -0,0 +1,123 @@
+// Provides the longest common prefix (LCP) array of a suffix array, plus the
+// LCP tables that let binary search skip characters it has already matched.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "suffix_array.h"
+
+// Fill the left and right LCP tables for every midpoint that a binary search
+// between low and high can visit, and return the LCP of the suffixes at low
+// and high. Bounds outside of the suffix array share no prefix with anything.
+static text_position fill_search_lcps(suffix_array* array, text_position low, text_position high) {
+    text_position mid;
+    text_position left;
+    text_position right;
+
+    if (high - low <= 1) {
+        return (low >= 0 && high < array->string_length) ? array->lcp[high] : 0;
+    }
+
+    // The midpoint must be chosen exactly like the search does.
+    mid = low + (high - low) / 2;
+    left = fill_search_lcps(array, low, mid);
+    right = fill_search_lcps(array, mid, high);
+    array->left_lcp[mid] = left;
+    array->right_lcp[mid] = right;
+
+    return (left < right) ? left : right;
+}
+
+// Build the LCP array of a suffix array with Kasai's linear-time algorithm.
+// Entry i holds the length of the common prefix of sorted suffixes i - 1 and i.
+flag build_lcp_array(suffix_array* array) {
+    text_position rank;
+    text_position matched;
+    text_position position;
+    text_position previous;
+    text_position limit;
+    text_position* ranks;
+    unsigned long long start_time;
+
+    if (array == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    // Don't rebuild an existing LCP array.
+    if (array->lcp != NULL) {
+        return FLAG_SUCCESS;
+    }
+    start_time = STATS_TIME();
+
+    if ((array->lcp = malloc(sizeof(text_position) * array->string_length)) == NULL) {
+        return FLAG_FAILURE;
+    }
+    if ((array->left_lcp = malloc(sizeof(text_position) * array->string_length)) == NULL) {
+        destroy_lcp_array(array);
+
+        return FLAG_FAILURE;
+    }
+    if ((array->right_lcp = malloc(sizeof(text_position) * array->string_length)) == NULL) {
+        destroy_lcp_array(array);
+
+        return FLAG_FAILURE;
+    }
+    if ((ranks = malloc(sizeof(text_position) * array->string_length)) == NULL) {
+        destroy_lcp_array(array);
+
+        return FLAG_FAILURE;
+    }
+
+    // Invert the suffix array so every position knows its sorted rank.
+    for (rank = 0; rank < array->string_length; rank++) {
+        ranks[suffix_at(array, rank)] = rank;
+    }
+
+    // Visit suffixes in string order. Dropping the first character of a suffix
+    // loses at most one matched character, so the match carries over.
+    matched = 0;
+    for (position = 0; position < array->string_length; position++) {
+        rank = ranks[position];
+        if (rank == 0) {
+            array->lcp[0] = 0;
+            matched = 0;
+        }
+        else {
+            previous = suffix_at(array, rank - 1);
+            limit = array->string_length - ((position > previous) ? position : previous);
+            matched += common_prefix_length(
+                array->string + position + matched,
+                array->string + previous + matched,
+                limit - matched
+            );
+            array->lcp[rank] = matched;
+            if (matched > 0) {
+                matched--;
+            }
+        }
+    }
+    free(ranks);
+
+    fill_search_lcps(array, -1, array->string_length);
+    STATS_PHASE(PHASE_LCP, start_time);
+
+    return FLAG_SUCCESS;
+}
+
+// Destroy the LCP array of a suffix array, if it has one. LCP
+// arrays loaded from an index file are left for the unmapping.
+void destroy_lcp_array(suffix_array* array) {
+
+    if (array == NULL) {
+        return;
+    }
+
+    if (!is_mapped(array, array->lcp)) {
+        free(array->lcp);
+        free(array->left_lcp);
+        free(array->right_lcp);
+    }
+    array->lcp = NULL;
+    array->left_lcp = NULL;
+    array->right_lcp = NULL;
+}
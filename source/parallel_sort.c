@@ -0,0 +1,642 @@
+// Sorts the suffixes of a suffix array on several threads using prefix
+// doubling. The suffixes are first sorted by as many leading characters as
+// fit in one key, and every round after that sorts the suffixes that are
+// still tied by twice as many characters as the last. Suffixes drop out as
+// soon as nothing is tied with them, so a round only touches the groups
+// that are left to split. Small groups are handed out whole to the threads,
+// while large ones are radix sorted by every thread together.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "suffix_array.h"
+
+#define DOUBLING_BUCKETS (1 << DOUBLING_RADIX_BITS)
+
+// A suffix paired with its sort key for the current round.
+typedef struct keyed_suffix {
+    text_position key;
+    text_position suffix;
+} keyed_suffix;
+
+// The state shared by every thread during one doubling round. Ranks are the
+// index of the last sorted suffix in each suffix's group, so suffixes with
+// equal ranks are still tied. The keys of each tied group are laid out one
+// group after another in pairs, starting at the group's offset. In the first
+// round the key packs the leading symbols of a suffix, and in every round
+// after it the key is the rank of the suffix that starts doubling characters
+// later.
+typedef struct doubling_state {
+    suffix_array* array;
+    text_position* ranks;
+    text_position doubling;
+    int prefix_symbols;
+    int symbol_bits;
+    int key_bits;
+    suffix_range* groups;
+    text_position* offsets;
+    text_position group_count;
+    text_position group_capacity;
+    text_position total;
+    keyed_suffix* pairs;
+    keyed_suffix* scratch;
+    text_position shared_size;
+    text_position* shared;
+    keyed_suffix** shared_results;
+    int shared_count;
+    text_position shared_group;
+    int shift;
+    keyed_suffix* source;
+    keyed_suffix* target;
+    text_position* counts;
+    int threads;
+} doubling_state;
+
+// The work handed to a single thread during one doubling round. Each thread
+// collects the groups that are still tied after its share of the round.
+typedef struct doubling_worker {
+    doubling_state* state;
+    int index;
+    suffix_range* found;
+    text_position found_count;
+    text_position found_capacity;
+    int running;
+    flag result;
+    pthread_t handle;
+} doubling_worker;
+
+// Compare two keyed suffixes by their keys.
+static int compare_keyed_suffixes(const void* first, const void* second) {
+    text_position first_key;
+    text_position second_key;
+
+    first_key = ((const keyed_suffix*) first)->key;
+    second_key = ((const keyed_suffix*) second)->key;
+
+    return (first_key > second_key) - (first_key < second_key);
+}
+
+// Find where one thread's equal share of a number of items starts.
+static text_position share_start(text_position count, int threads, int thread) {
+    return count / threads * thread + count % threads * thread / threads;
+}
+
+// Determine if a group is large enough to be sorted by every thread at once.
+static int is_shared(doubling_state* state, text_position size) {
+    return state->threads > 1 && size >= state->shared_size;
+}
+
+// Find the group whose keys hold an element of the pairs.
+static text_position group_containing(doubling_state* state, text_position element) {
+    text_position low;
+    text_position mid;
+    text_position high;
+
+    low = 0;
+    high = state->group_count;
+    while (high - low > 1) {
+        mid = low + (high - low) / 2;
+        if (state->offsets[mid] <= element) {
+            low = mid;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+// Get the sort key of a suffix for the current round. Suffixes that run out
+// of characters get the lowest key, and symbols past the end of the string
+// pack as 0, below every symbol that appears.
+static text_position suffix_key(doubling_state* state, text_position suffix) {
+    int symbol;
+    text_position key;
+    text_position target;
+    suffix_array* array;
+
+    array = state->array;
+    if (state->doubling == 0) {
+        key = 0;
+        for (symbol = 0; symbol < state->prefix_symbols; symbol++) {
+            key <<= state->symbol_bits;
+            if (suffix + symbol < array->string_length) {
+                key |= array->symbols[(unsigned char) array->string[suffix + symbol]];
+            }
+        }
+
+        return key;
+    }
+
+    target = suffix + state->doubling;
+
+    return (target < array->string_length) ? state->ranks[target] + 1 : 0;
+}
+
+// Fill in the keys of the worker's share of the tied suffixes.
+static void* fill_keys(void* argument) {
+    text_position end;
+    text_position group;
+    text_position element;
+    text_position suffix;
+    doubling_state* state;
+    doubling_worker* worker;
+
+    worker = (doubling_worker*) argument;
+    state = worker->state;
+    element = share_start(state->total, state->threads, worker->index);
+    end = share_start(state->total, state->threads, worker->index + 1);
+    if (element >= end) {
+        return NULL;
+    }
+
+    group = group_containing(state, element);
+    for (; element < end; element++) {
+        if (element == state->offsets[group + 1]) {
+            group++;
+        }
+        suffix = state->array->suffixes[state->groups[group].low + element - state->offsets[group]];
+        state->pairs[element].key = suffix_key(state, suffix);
+        state->pairs[element].suffix = suffix;
+    }
+
+    return NULL;
+}
+
+// Count the digits of the worker's share of a shared group during one pass
+// of its radix sort.
+static void* count_digits(void* argument) {
+    text_position end;
+    text_position size;
+    text_position element;
+    text_position* counts;
+    doubling_state* state;
+    doubling_worker* worker;
+
+    worker = (doubling_worker*) argument;
+    state = worker->state;
+    counts = state->counts + (size_t) worker->index * DOUBLING_BUCKETS;
+    memset(counts, 0, sizeof(text_position) * DOUBLING_BUCKETS);
+
+    size = state->offsets[state->shared_group + 1] - state->offsets[state->shared_group];
+    element = state->offsets[state->shared_group] + share_start(size, state->threads, worker->index);
+    end = state->offsets[state->shared_group] + share_start(size, state->threads, worker->index + 1);
+    for (; element < end; element++) {
+        counts[(state->source[element].key >> state->shift) & (DOUBLING_BUCKETS - 1)]++;
+    }
+
+    return NULL;
+}
+
+// Scatter the worker's share of a shared group into its buckets during one
+// pass of its radix sort. Each thread's part of a bucket follows the parts
+// of the threads before it, so every pass is stable.
+static void* scatter_digits(void* argument) {
+    int thread;
+    int bucket;
+    text_position end;
+    text_position sum;
+    text_position size;
+    text_position element;
+    doubling_state* state;
+    doubling_worker* worker;
+    text_position next[DOUBLING_BUCKETS];
+
+    worker = (doubling_worker*) argument;
+    state = worker->state;
+    sum = state->offsets[state->shared_group];
+    for (bucket = 0; bucket < DOUBLING_BUCKETS; bucket++) {
+        for (thread = 0; thread < state->threads; thread++) {
+            if (thread == worker->index) {
+                next[bucket] = sum;
+            }
+            sum += state->counts[(size_t) thread * DOUBLING_BUCKETS + bucket];
+        }
+    }
+
+    size = state->offsets[state->shared_group + 1] - state->offsets[state->shared_group];
+    element = state->offsets[state->shared_group] + share_start(size, state->threads, worker->index);
+    end = state->offsets[state->shared_group] + share_start(size, state->threads, worker->index + 1);
+    for (; element < end; element++) {
+        state->target[next[(state->source[element].key >> state->shift) & (DOUBLING_BUCKETS - 1)]++] = (
+            state->source[element]
+        );
+    }
+
+    return NULL;
+}
+
+// Radix sort keyed suffixes on a single thread, a digit at a time, using
+// scratch as a second buffer. Passes where every digit is the same are
+// skipped. Returns whichever of the two buffers ends up sorted.
+static keyed_suffix* radix_sort(
+    keyed_suffix* source,
+    keyed_suffix* scratch,
+    text_position size,
+    int key_bits,
+    text_position* counts
+) {
+    int shift;
+    int bucket;
+    text_position sum;
+    text_position count;
+    text_position element;
+    keyed_suffix* swap;
+
+    for (shift = 0; shift < key_bits; shift += DOUBLING_RADIX_BITS) {
+        memset(counts, 0, sizeof(text_position) * DOUBLING_BUCKETS);
+        for (element = 0; element < size; element++) {
+            counts[(source[element].key >> shift) & (DOUBLING_BUCKETS - 1)]++;
+        }
+        if (counts[(source[0].key >> shift) & (DOUBLING_BUCKETS - 1)] == size) {
+            continue;
+        }
+
+        sum = 0;
+        for (bucket = 0; bucket < DOUBLING_BUCKETS; bucket++) {
+            count = counts[bucket];
+            counts[bucket] = sum;
+            sum += count;
+        }
+        for (element = 0; element < size; element++) {
+            scratch[counts[(source[element].key >> shift) & (DOUBLING_BUCKETS - 1)]++] = source[element];
+        }
+        swap = source;
+        source = scratch;
+        scratch = swap;
+    }
+
+    return source;
+}
+
+// Sort the keys of a group on the worker's thread. Returns where the sorted
+// keys ended up, which is either the group's pairs or its scratch space.
+static keyed_suffix* sort_group(doubling_worker* worker, text_position group) {
+    text_position size;
+    text_position element;
+    text_position slot;
+    keyed_suffix* pairs;
+    keyed_suffix moved;
+    doubling_state* state;
+
+    state = worker->state;
+    pairs = state->pairs + state->offsets[group];
+    size = state->offsets[group + 1] - state->offsets[group];
+    if (size >= DOUBLING_RADIX_MIN) {
+        return radix_sort(
+            pairs,
+            state->scratch + state->offsets[group],
+            size,
+            state->key_bits,
+            state->counts + (size_t) worker->index * DOUBLING_BUCKETS
+        );
+    }
+    else if (size > DOUBLING_INSERTION_MAX) {
+        qsort(pairs, size, sizeof(keyed_suffix), compare_keyed_suffixes);
+
+        return pairs;
+    }
+
+    for (element = 1; element < size; element++) {
+        moved = pairs[element];
+        for (slot = element; slot > 0 && pairs[slot - 1].key > moved.key; slot--) {
+            pairs[slot] = pairs[slot - 1];
+        }
+        pairs[slot] = moved;
+    }
+
+    return pairs;
+}
+
+// Remember a group that is still tied after this round.
+static flag save_group(doubling_worker* worker, text_position low, text_position high) {
+    text_position capacity;
+    suffix_range* resized;
+
+    if (worker->found_count == worker->found_capacity) {
+        capacity = 2 * worker->found_capacity + 16;
+        if ((resized = realloc(worker->found, sizeof(suffix_range) * capacity)) == NULL) {
+            return FLAG_FAILURE;
+        }
+        worker->found = resized;
+        worker->found_capacity = capacity;
+        STATS_BUILD_ADD(bucket_allocations, 1);
+    }
+    worker->found[worker->found_count].low = low;
+    worker->found[worker->found_count].high = high;
+    worker->found_count++;
+
+    return FLAG_SUCCESS;
+}
+
+// Hand out new ranks to the runs of equal keys that start between first and
+// last in the sorted keys of a group, which begins at low in the suffix
+// array. A run that starts before first belongs to the thread whose share
+// it starts in, even if it reaches into this one.
+static flag rank_runs(
+    doubling_worker* worker,
+    keyed_suffix* sorted,
+    text_position low,
+    text_position size,
+    text_position first,
+    text_position last
+) {
+    text_position start;
+    text_position end;
+    text_position element;
+    doubling_state* state;
+
+    state = worker->state;
+    start = first;
+    while (first > 0 && start < last && sorted[start].key == sorted[first - 1].key) {
+        start++;
+    }
+
+    while (start < last) {
+        end = start + 1;
+        while (end < size && sorted[end].key == sorted[start].key) {
+            end++;
+        }
+        for (element = start; element < end; element++) {
+            state->array->suffixes[low + element] = sorted[element].suffix;
+            state->ranks[sorted[element].suffix] = low + end - 1;
+        }
+        if (end - start > 1 && save_group(worker, low + start, low + end) == FLAG_FAILURE) {
+            return FLAG_FAILURE;
+        }
+        start = end;
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Sort and rank every group that isn't shared and whose keys start in the
+// worker's share of the pairs, then rank the worker's share of every shared
+// group, which is already sorted.
+static void* split_groups(void* argument) {
+    int shared;
+    text_position end;
+    text_position size;
+    text_position group;
+    text_position start;
+    keyed_suffix* sorted;
+    doubling_state* state;
+    doubling_worker* worker;
+
+    worker = (doubling_worker*) argument;
+    state = worker->state;
+    worker->result = FLAG_SUCCESS;
+
+    start = share_start(state->total, state->threads, worker->index);
+    end = share_start(state->total, state->threads, worker->index + 1);
+    if (start < end) {
+        group = group_containing(state, start);
+        if (state->offsets[group] < start) {
+            group++;
+        }
+        for (; group < state->group_count && state->offsets[group] < end; group++) {
+            size = state->offsets[group + 1] - state->offsets[group];
+            if (is_shared(state, size)) {
+                continue;
+            }
+            sorted = sort_group(worker, group);
+            if (rank_runs(worker, sorted, state->groups[group].low, size, 0, size) == FLAG_FAILURE) {
+                worker->result = FLAG_FAILURE;
+
+                return NULL;
+            }
+        }
+    }
+
+    for (shared = 0; shared < state->shared_count; shared++) {
+        group = state->shared[shared];
+        size = state->offsets[group + 1] - state->offsets[group];
+        if (
+            rank_runs(
+                worker,
+                state->shared_results[shared],
+                state->groups[group].low,
+                size,
+                share_start(size, state->threads, worker->index),
+                share_start(size, state->threads, worker->index + 1)
+            ) == FLAG_FAILURE
+        ) {
+            worker->result = FLAG_FAILURE;
+
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+// Run one phase of a round on every thread. The calling thread takes the
+// first share itself, along with any share whose thread couldn't be started.
+static void run_phase(doubling_state* state, doubling_worker* workers, void* (*phase)(void*)) {
+    int thread;
+
+    for (thread = 1; thread < state->threads; thread++) {
+        workers[thread].running = (pthread_create(&workers[thread].handle, NULL, phase, &workers[thread]) == 0);
+    }
+    for (thread = 0; thread < state->threads; thread++) {
+        if (!workers[thread].running) {
+            phase(&workers[thread]);
+        }
+    }
+    for (thread = 1; thread < state->threads; thread++) {
+        if (workers[thread].running) {
+            pthread_join(workers[thread].handle, NULL);
+            workers[thread].running = 0;
+        }
+    }
+}
+
+// Radix sort a shared group with every thread, one digit at a time. Passes
+// where every digit is the same are skipped.
+static void sort_shared_group(doubling_state* state, doubling_worker* workers, int shared) {
+    int thread;
+    int bucket;
+    text_position size;
+    text_position count;
+    keyed_suffix* swap;
+
+    state->shared_group = state->shared[shared];
+    state->source = state->pairs;
+    state->target = state->scratch;
+    size = state->offsets[state->shared_group + 1] - state->offsets[state->shared_group];
+    for (state->shift = 0; state->shift < state->key_bits; state->shift += DOUBLING_RADIX_BITS) {
+        run_phase(state, workers, count_digits);
+        bucket = (state->source[state->offsets[state->shared_group]].key >> state->shift) & (DOUBLING_BUCKETS - 1);
+        count = 0;
+        for (thread = 0; thread < state->threads; thread++) {
+            count += state->counts[(size_t) thread * DOUBLING_BUCKETS + bucket];
+        }
+        if (count == size) {
+            continue;
+        }
+
+        run_phase(state, workers, scatter_digits);
+        swap = state->source;
+        state->source = state->target;
+        state->target = swap;
+    }
+    state->shared_results[shared] = state->source + state->offsets[state->shared_group];
+}
+
+// Split every tied group by the keys of the current round, and gather the
+// groups that are still tied for the next one.
+static flag run_round(doubling_state* state, doubling_worker* workers) {
+    int thread;
+    text_position group;
+    text_position size;
+    text_position found;
+    text_position capacity;
+    suffix_range* groups;
+    text_position* offsets;
+
+    state->total = 0;
+    for (group = 0; group < state->group_count; group++) {
+        state->offsets[group] = state->total;
+        state->total += state->groups[group].high - state->groups[group].low;
+    }
+    state->offsets[state->group_count] = state->total;
+
+    // A group is shared once it holds at least half of a thread's share of
+    // the round, so there are never more than twice as many as threads.
+    state->shared_size = (state->total + 2 * state->threads - 1) / (2 * state->threads);
+    if (state->shared_size < DOUBLING_SHARED_MIN) {
+        state->shared_size = DOUBLING_SHARED_MIN;
+    }
+    state->shared_count = 0;
+    for (group = 0; group < state->group_count; group++) {
+        size = state->groups[group].high - state->groups[group].low;
+        if (is_shared(state, size)) {
+            state->shared[state->shared_count++] = group;
+        }
+    }
+
+    run_phase(state, workers, fill_keys);
+    for (thread = 0; thread < state->shared_count; thread++) {
+        sort_shared_group(state, workers, thread);
+    }
+    run_phase(state, workers, split_groups);
+
+    found = 0;
+    for (thread = 0; thread < state->threads; thread++) {
+        if (workers[thread].result == FLAG_FAILURE) {
+            return FLAG_FAILURE;
+        }
+        found += workers[thread].found_count;
+    }
+    if (found > state->group_capacity) {
+        capacity = 2 * found;
+        if ((groups = realloc(state->groups, sizeof(suffix_range) * capacity)) == NULL) {
+            return FLAG_FAILURE;
+        }
+        state->groups = groups;
+        if ((offsets = realloc(state->offsets, sizeof(text_position) * (capacity + 1))) == NULL) {
+            return FLAG_FAILURE;
+        }
+        state->offsets = offsets;
+        state->group_capacity = capacity;
+    }
+    state->group_count = 0;
+    for (thread = 0; thread < state->threads; thread++) {
+        if (workers[thread].found_count > 0) {
+            memcpy(
+                state->groups + state->group_count,
+                workers[thread].found,
+                sizeof(suffix_range) * workers[thread].found_count
+            );
+        }
+        state->group_count += workers[thread].found_count;
+        workers[thread].found_count = 0;
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Sort the suffixes in a suffix array alphabetically using the given number
+// of threads. The result is identical to every other sorting method.
+flag sort_suffixes_in_parallel(suffix_array* array, int threads) {
+    int thread;
+    text_position position;
+    flag result;
+    doubling_state state;
+    doubling_worker* workers;
+
+    if (array == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    if (threads < 1) {
+        threads = default_thread_count();
+    }
+
+    memset(&state, 0, sizeof(doubling_state));
+    state.array = array;
+    state.threads = threads;
+    state.group_capacity = 1;
+    state.ranks = malloc(sizeof(text_position) * array->string_length);
+    state.pairs = malloc(sizeof(keyed_suffix) * array->string_length);
+    state.scratch = malloc(sizeof(keyed_suffix) * array->string_length);
+    state.groups = malloc(sizeof(suffix_range));
+    state.offsets = malloc(sizeof(text_position) * 2);
+    state.shared = malloc(sizeof(text_position) * 2 * threads);
+    state.shared_results = malloc(sizeof(keyed_suffix*) * 2 * threads);
+    state.counts = malloc(sizeof(text_position) * DOUBLING_BUCKETS * threads);
+    workers = calloc(threads, sizeof(doubling_worker));
+    result = FLAG_SUCCESS;
+    if (
+        state.ranks == NULL || state.pairs == NULL || state.scratch == NULL
+        || state.groups == NULL || state.offsets == NULL || state.shared == NULL
+        || state.shared_results == NULL || state.counts == NULL || workers == NULL
+    ) {
+        result = FLAG_FAILURE;
+    }
+    for (thread = 0; workers != NULL && thread < threads; thread++) {
+        workers[thread].state = &state;
+        workers[thread].index = thread;
+    }
+
+    // Every suffix starts out in one group, which the first round sorts by
+    // as many leading symbols as fit in a key.
+    for (position = 0; position < array->string_length; position++) {
+        array->suffixes[position] = position;
+    }
+    state.symbol_bits = bits_needed(array->alphabet_size + 1);
+    state.prefix_symbols = DOUBLING_PREFIX_BITS / state.symbol_bits;
+    state.key_bits = state.prefix_symbols * state.symbol_bits;
+    state.doubling = 0;
+    if (result == FLAG_SUCCESS && array->string_length > 1) {
+        state.groups[0].low = 0;
+        state.groups[0].high = array->string_length;
+        state.group_count = 1;
+    }
+
+    // Double the sorted prefix length until no two suffixes are tied.
+    while (state.group_count > 0 && result == FLAG_SUCCESS) {
+        STATS_BUILD_ADD(sort_passes, 1);
+        result = run_round(&state, workers);
+        state.doubling = (state.doubling == 0) ? state.prefix_symbols : 2 * state.doubling;
+        state.key_bits = bits_needed(array->string_length + 1);
+    }
+
+    for (thread = 0; workers != NULL && thread < threads; thread++) {
+        free(workers[thread].found);
+    }
+    free(state.ranks);
+    free(state.pairs);
+    free(state.scratch);
+    free(state.groups);
+    free(state.offsets);
+    free(state.shared);
+    free(state.shared_results);
+    free(state.counts);
+    free(workers);
+
+    return result;
+}
@@ -0,0 +1,124 @@
+// Provides a prefix table for a suffix array, which maps every string of
+// prefix_length symbols to the range of sorted suffixes that start with it.
+// Searches use it to skip the first, most scattered probes of binary search.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "suffix_array.h"
+
+// Build the prefix table of a suffix array. Every prefix is numbered as if
+// its symbols were digits, with one more digit value than the alphabet has
+// so that suffixes shorter than the prefix length can be padded with 0s.
+// These numbers sort exactly like the suffixes do, so a running count of
+// suffixes per number gives the start of every range. A length below 1
+// picks the longest prefixes whose table is no bigger than the string.
+flag build_prefix_table(suffix_array* array, int length) {
+    size_t base;
+    size_t code;
+    size_t top;
+    size_t entries;
+    text_position position;
+    unsigned long long start_time;
+
+    if (array == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    // Don't rebuild an existing prefix table.
+    if (array->prefix_table != NULL) {
+        return FLAG_SUCCESS;
+    }
+
+    base = array->alphabet_size + 1;
+    entries = 1;
+    if (length < 1) {
+        length = 0;
+        while (entries * base <= (size_t) array->string_length && entries * base <= PREFIX_TABLE_MAX_ENTRIES) {
+            entries *= base;
+            length++;
+        }
+
+        // The string is too short for a table to help.
+        if (length == 0) {
+            return FLAG_SUCCESS;
+        }
+    }
+    else {
+        for (top = 0; top < (size_t) length; top++) {
+            if (entries * base > PREFIX_TABLE_MAX_ENTRIES) {
+                return FLAG_FAILURE;
+            }
+            entries *= base;
+        }
+    }
+
+    start_time = STATS_TIME();
+    if ((array->prefix_table = calloc(entries + 1, sizeof(text_position))) == NULL) {
+        return FLAG_FAILURE;
+    }
+    array->prefix_length = length;
+
+    // Number the prefixes from right to left, so each number is the next
+    // one shifted down by a digit with a new top digit added.
+    top = entries / base;
+    code = 0;
+    for (position = array->string_length - 1; position >= 0; position--) {
+        code = array->symbols[(unsigned char) array->string[position]] * top + code / base;
+        array->prefix_table[code + 1]++;
+    }
+
+    // Turn the counts into the index of the first suffix with each prefix.
+    for (code = 1; code <= entries; code++) {
+        array->prefix_table[code] += array->prefix_table[code - 1];
+    }
+    STATS_PHASE(PHASE_PREFIX_TABLE, start_time);
+
+    return FLAG_SUCCESS;
+}
+
+// Find the range of sorted suffixes that start with the first prefix_length
+// characters of a pattern, or with the whole pattern if it's shorter. This
+// takes two table lookups, no matter how many suffixes match.
+void prefix_range(suffix_array* array, char* pattern, text_position pattern_length, suffix_range* range) {
+    int symbol;
+    size_t base;
+    size_t code;
+    size_t span;
+    text_position character;
+
+    base = array->alphabet_size + 1;
+    span = 1;
+    for (character = 0; character < array->prefix_length; character++) {
+        span *= base;
+    }
+
+    // A short pattern stands for every prefix that it starts, which is a
+    // contiguous run of numbers.
+    code = 0;
+    for (character = 0; character < array->prefix_length && character < pattern_length; character++) {
+        if ((symbol = array->symbols[(unsigned char) pattern[character]]) == 0) {
+            range->low = 0;
+            range->high = 0;
+
+            return;
+        }
+        span /= base;
+        code += symbol * span;
+    }
+
+    range->low = array->prefix_table[code];
+    range->high = array->prefix_table[code + span];
+}
+
+// Destroy the prefix table of a suffix array, if it has one.
+void destroy_prefix_table(suffix_array* array) {
+
+    if (array == NULL) {
+        return;
+    }
+
+    free(array->prefix_table);
+    array->prefix_table = NULL;
+    array->prefix_length = 0;
+}
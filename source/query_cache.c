@@ -0,0 +1,184 @@
+// Provides a cache of search results for a suffix array, so patterns that are
+// searched over and over skip the binary search after their first time.
+// Any number of threads may search through the same cache at once. Only
+// suffix arrays that never change may have a cache, since nothing ever
+// checks a cached range again.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "suffix_array.h"
+
+// Hash a pattern with 64-bit FNV-1a.
+static unsigned long long hash_pattern(const char* pattern, text_position pattern_length) {
+    text_position index;
+    unsigned long long hash;
+
+    hash = 14695981039346656037ULL;
+    for (index = 0; index < pattern_length; index++) {
+        hash = (hash ^ (unsigned char) pattern[index]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Build a query cache for a suffix array that holds at least the given number
+// of entries, rounded up to a power of two sets of QUERY_CACHE_WAYS entries.
+// Once built, search_range answers from the cache whenever it can.
+flag build_query_cache(suffix_array* array, size_t entries) {
+    int lock;
+    query_cache* cache;
+
+    if (array == NULL || entries == 0) {
+        return FLAG_FAILURE;
+    }
+
+    // Don't rebuild an existing query cache.
+    if (array->cache != NULL) {
+        return FLAG_SUCCESS;
+    }
+
+    if ((cache = calloc(1, sizeof(query_cache))) == NULL) {
+        return FLAG_FAILURE;
+    }
+    cache->set_count = 1;
+    while (cache->set_count * QUERY_CACHE_WAYS < entries) {
+        cache->set_count *= 2;
+    }
+
+    // Set clocks start at 1, so entries that were never used are empty.
+    cache->entries = calloc(cache->set_count * QUERY_CACHE_WAYS, sizeof(cache_entry));
+    cache->set_clocks = calloc(cache->set_count, sizeof(unsigned long long));
+    if (cache->entries == NULL || cache->set_clocks == NULL) {
+        free(cache->entries);
+        free(cache->set_clocks);
+        free(cache);
+
+        return FLAG_FAILURE;
+    }
+    for (lock = 0; lock < QUERY_CACHE_LOCKS; lock++) {
+        if (pthread_mutex_init(&cache->locks[lock], NULL) != 0) {
+            while (--lock >= 0) {
+                pthread_mutex_destroy(&cache->locks[lock]);
+            }
+            free(cache->entries);
+            free(cache->set_clocks);
+            free(cache);
+
+            return FLAG_FAILURE;
+        }
+    }
+    array->cache = cache;
+
+    return FLAG_SUCCESS;
+}
+
+// Look for a pattern in a query cache, copying its range into range if it's
+// there. Patterns too long to cache are never found. Returns 1 on a hit and 0
+// on a miss.
+int find_cached_range(query_cache* cache, const char* pattern, text_position pattern_length, suffix_range* range) {
+    int found;
+    size_t set;
+    size_t way;
+    unsigned int tag;
+    unsigned long long hash;
+    cache_entry* entry;
+
+    if (pattern_length > QUERY_CACHE_KEY_SIZE) {
+        __atomic_fetch_add(&cache->misses, 1, __ATOMIC_RELAXED);
+
+        return 0;
+    }
+
+    hash = hash_pattern(pattern, pattern_length);
+    set = hash & (cache->set_count - 1);
+    tag = (unsigned int) (hash >> 32);
+    found = 0;
+    pthread_mutex_lock(&cache->locks[set % QUERY_CACHE_LOCKS]);
+    for (way = 0; way < QUERY_CACHE_WAYS; way++) {
+        entry = &cache->entries[set * QUERY_CACHE_WAYS + way];
+        if (
+            entry->last_used != 0
+            && entry->tag == tag
+            && entry->pattern_length == (unsigned int) pattern_length
+            && memcmp(entry->pattern, pattern, pattern_length) == 0
+        ) {
+            entry->last_used = ++cache->set_clocks[set];
+            *range = entry->range;
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->locks[set % QUERY_CACHE_LOCKS]);
+    __atomic_fetch_add(found ? &cache->hits : &cache->misses, 1, __ATOMIC_RELAXED);
+
+    return found;
+}
+
+// Save the range of a pattern in a query cache. It takes the place of the
+// set's least recently used entry, though an empty entry is always filled
+// first.
+void cache_range(query_cache* cache, const char* pattern, text_position pattern_length, suffix_range* range) {
+    size_t set;
+    size_t way;
+    unsigned int tag;
+    unsigned long long hash;
+    unsigned long long oldest;
+    cache_entry* entry;
+    cache_entry* victim;
+
+    if (pattern_length > QUERY_CACHE_KEY_SIZE) {
+        return;
+    }
+
+    hash = hash_pattern(pattern, pattern_length);
+    set = hash & (cache->set_count - 1);
+    tag = (unsigned int) (hash >> 32);
+    pthread_mutex_lock(&cache->locks[set % QUERY_CACHE_LOCKS]);
+    victim = NULL;
+    oldest = ULLONG_MAX;
+    for (way = 0; way < QUERY_CACHE_WAYS; way++) {
+        entry = &cache->entries[set * QUERY_CACHE_WAYS + way];
+
+        // Another thread may have just cached the same pattern.
+        if (
+            entry->last_used != 0
+            && entry->tag == tag
+            && entry->pattern_length == (unsigned int) pattern_length
+            && memcmp(entry->pattern, pattern, pattern_length) == 0
+        ) {
+            victim = entry;
+            break;
+        }
+
+        // An empty entry looks older than any other.
+        if (entry->last_used < oldest) {
+            oldest = entry->last_used;
+            victim = entry;
+        }
+    }
+    memcpy(victim->pattern, pattern, pattern_length);
+    victim->pattern_length = (unsigned int) pattern_length;
+    victim->tag = tag;
+    victim->last_used = ++cache->set_clocks[set];
+    victim->range = *range;
+    pthread_mutex_unlock(&cache->locks[set % QUERY_CACHE_LOCKS]);
+}
+
+// Destroy the query cache of a suffix array, if it has one.
+void destroy_query_cache(suffix_array* array) {
+    int lock;
+
+    if (array == NULL || array->cache == NULL) {
+        return;
+    }
+
+    for (lock = 0; lock < QUERY_CACHE_LOCKS; lock++) {
+        pthread_mutex_destroy(&array->cache->locks[lock]);
+    }
+    free(array->cache->entries);
+    free(array->cache->set_clocks);
+    free(array->cache);
+    array->cache = NULL;
+}
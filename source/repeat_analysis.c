@@ -0,0 +1,276 @@
+// Finds repeated substrings of a string, and substrings shared between two
+// strings, in a single pass over the sorted suffixes and their LCP array.
+// Suffixes that share a prefix sit next to each other once sorted, so every
+// repeat shows up as a run of large LCP values. Results are written out as
+// they are found, so none of them have to be held in memory.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "suffix_array.h"
+
+// The characters before the suffixes of an LCP interval are either all the
+// same, or are one of these.
+#define LEFT_NONE -1
+#define LEFT_MIXED -2
+
+// An interval of sorted suffixes, starting at low, that all share a prefix of
+// length lcp. Left is the character before every one of its suffixes seen so
+// far, or LEFT_MIXED if they differ.
+typedef struct lcp_interval {
+    text_position lcp;
+    text_position low;
+    int left;
+} lcp_interval;
+
+// Get the character before the sorted suffix at an index, or LEFT_MIXED for
+// the first suffix of the string, which can never be extended to the left.
+static int left_character(suffix_array* array, text_position index) {
+    text_position position;
+
+    position = suffix_at(array, index);
+
+    return (position == 0) ? LEFT_MIXED : (unsigned char) array->string[position - 1];
+}
+
+// Combine what is known about the characters before two sets of suffixes.
+static int merge_left(int first, int second) {
+
+    if (first == LEFT_NONE) {
+        return second;
+    }
+
+    return (first == second) ? first : LEFT_MIXED;
+}
+
+// Find the longest substring that appears more than once in the string,
+// building the LCP array if there isn't one yet. Two of the positions where
+// it appears are saved in first and second. The length is 0 if no character
+// repeats at all.
+flag longest_repeat(suffix_array* array, text_position* first, text_position* second, text_position* length) {
+    text_position index;
+    text_position longest;
+
+    if (array == NULL || first == NULL || second == NULL || length == NULL) {
+        return FLAG_FAILURE;
+    }
+    if (build_lcp_array(array) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
+    }
+
+    longest = 0;
+    for (index = 1; index < array->string_length; index++) {
+        if (array->lcp[index] > array->lcp[longest]) {
+            longest = index;
+        }
+    }
+    *length = array->lcp[longest];
+    if (*length == 0) {
+        *first = 0;
+        *second = 0;
+    }
+    else {
+        *first = suffix_at(array, longest - 1);
+        *second = suffix_at(array, longest);
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Write every maximal repeat of at least a minimum length to a stream, one per
+// line, as its length, the number of times it appears, and one position where
+// it appears, separated by tabs. A maximal repeat appears more than once, and
+// not every occurrence continues with the same character or follows the same
+// character, so it can't be grown into a longer repeat that appears just as
+// often. The repeats that share a prefix form an LCP interval, and the
+// intervals are visited with a stack in a single pass, innermost first. Each
+// interval collects the characters before its suffixes from the intervals
+// nested in it as they close. Returns the number of repeats written.
+text_position print_maximal_repeats(suffix_array* array, text_position min_length, FILE* stream) {
+    int left;
+    text_position low;
+    text_position index;
+    text_position count;
+    text_position lcp;
+    text_position depth;
+    text_position capacity;
+    lcp_interval* stack;
+    lcp_interval* resized;
+
+    if (array == NULL || stream == NULL || min_length < 1) {
+        return FLAG_FAILURE;
+    }
+    if (build_lcp_array(array) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
+    }
+
+    capacity = 64;
+    if ((stack = malloc(sizeof(lcp_interval) * capacity)) == NULL) {
+        return FLAG_FAILURE;
+    }
+    stack[0].lcp = 0;
+    stack[0].low = 0;
+    stack[0].left = LEFT_NONE;
+    depth = 1;
+    count = 0;
+
+    // Between each pair of neighbouring suffixes, close every interval whose
+    // prefix is longer than theirs, then open one if their prefix is longer
+    // than that of every interval still open. The end of the array closes
+    // every interval but the outermost.
+    for (index = 1; index <= array->string_length; index++) {
+        lcp = (index < array->string_length) ? array->lcp[index] : 0;
+        left = left_character(array, index - 1);
+        low = index - 1;
+        while (lcp < stack[depth - 1].lcp) {
+            depth--;
+            stack[depth].left = merge_left(stack[depth].left, left);
+            if (stack[depth].lcp >= min_length && stack[depth].left == LEFT_MIXED) {
+                fprintf(
+                    stream,
+                    TEXT_POSITION_FORMAT "\t" TEXT_POSITION_FORMAT "\t" TEXT_POSITION_FORMAT "\n",
+                    stack[depth].lcp,
+                    index - stack[depth].low,
+                    suffix_at(array, stack[depth].low)
+                );
+                count++;
+            }
+            left = stack[depth].left;
+            low = stack[depth].low;
+        }
+        if (lcp > stack[depth - 1].lcp) {
+            if (depth == capacity) {
+                capacity *= 2;
+                if ((resized = realloc(stack, sizeof(lcp_interval) * capacity)) == NULL) {
+                    free(stack);
+
+                    return FLAG_FAILURE;
+                }
+                stack = resized;
+            }
+            stack[depth].lcp = lcp;
+            stack[depth].low = low;
+            stack[depth].left = left;
+            depth++;
+        }
+        else {
+            stack[depth - 1].left = merge_left(stack[depth - 1].left, left);
+        }
+    }
+    free(stack);
+
+    return count;
+}
+
+// Find the longest substring shared by the two documents of a collection,
+// building the LCP array if there isn't one yet. Its offsets within the first
+// and second documents are saved in first and second. The length is 0 if the
+// documents share no characters at all.
+flag longest_common_substring(
+    document_collection* collection,
+    text_position* first,
+    text_position* second,
+    text_position* length
+) {
+    text_position index;
+    text_position position;
+    text_position previous;
+    suffix_array* array;
+
+    if (collection == NULL || collection->document_count != 2 || first == NULL || second == NULL || length == NULL) {
+        return FLAG_FAILURE;
+    }
+    array = collection->array;
+    if (build_lcp_array(array) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
+    }
+
+    // The separator appears only once, so no common prefix runs past it.
+    *first = 0;
+    *second = 0;
+    *length = 0;
+    for (index = 1; index < array->string_length; index++) {
+        if (array->lcp[index] <= *length) {
+            continue;
+        }
+        previous = suffix_at(array, index - 1);
+        position = suffix_at(array, index);
+        if ((previous < collection->starts[1]) == (position < collection->starts[1])) {
+            continue;
+        }
+        if (position < previous) {
+            *first = position;
+            *second = previous - collection->starts[1];
+        }
+        else {
+            *first = previous;
+            *second = position - collection->starts[1];
+        }
+        *length = array->lcp[index];
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Write every maximal unique match of at least a minimum length between the
+// two documents of a collection to a stream, one per line, as its offset in
+// the first document, its offset in the second, and its length, separated by
+// tabs. A maximal unique match appears exactly once in each document and
+// can't be grown in either direction. Such a match sorts as a pair of
+// neighbouring suffixes, one from each document, whose common prefix is
+// longer than that of either suffix with its other neighbour, and which are
+// preceded by different characters. The matches come out in sorted suffix
+// order. Returns the number of matches written.
+text_position print_maximal_unique_matches(document_collection* collection, text_position min_length, FILE* stream) {
+    text_position lcp;
+    text_position index;
+    text_position count;
+    text_position position;
+    text_position previous;
+    text_position boundary;
+    suffix_array* array;
+
+    if (collection == NULL || collection->document_count != 2 || stream == NULL || min_length < 1) {
+        return FLAG_FAILURE;
+    }
+    array = collection->array;
+    if (build_lcp_array(array) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
+    }
+
+    boundary = collection->starts[1];
+    count = 0;
+    for (index = 1; index < array->string_length; index++) {
+        lcp = array->lcp[index];
+        if (
+            lcp < min_length
+            || (index > 1 && array->lcp[index - 1] >= lcp)
+            || (index + 1 < array->string_length && array->lcp[index + 1] >= lcp)
+        ) {
+            continue;
+        }
+        previous = suffix_at(array, index - 1);
+        position = suffix_at(array, index);
+        if ((previous < boundary) == (position < boundary)) {
+            continue;
+        }
+
+        // A match at the start of either document can't grow to the left.
+        if (
+            previous != 0 && previous != boundary && position != 0 && position != boundary
+            && array->string[previous - 1] == array->string[position - 1]
+        ) {
+            continue;
+        }
+        fprintf(
+            stream,
+            TEXT_POSITION_FORMAT "\t" TEXT_POSITION_FORMAT "\t" TEXT_POSITION_FORMAT "\n",
+            (previous < boundary) ? previous : position,
+            ((previous < boundary) ? position : previous) - boundary,
+            lcp
+        );
+        count++;
+    }
+
+    return count;
+}
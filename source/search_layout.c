@@ -0,0 +1,160 @@
+// Provides a compact search layout for a suffix array. Every few sorted
+// suffixes are sampled, and as many of the first symbols of each sample as
+// fit in 8 bytes are stored inline in Eytzinger order, which lays out a
+// binary search tree level by level. The top of a search then walks a small,
+// contiguous array without touching the suffixes or the string, before the
+// suffix array finishes it.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "suffix_array.h"
+
+// Pack the symbols at the start of a string into an integer that compares
+// like the symbols do. Small alphabets fit more symbols, such as 21 for DNA.
+// Missing symbols are replaced by 0 or, if fill is set, by the highest value
+// that fits. Returns 0 if the string has a character outside the alphabet.
+static unsigned long long make_key(suffix_array* array, char* string, text_position length, int fill) {
+    int slot;
+    int bits;
+    int symbol;
+    unsigned long long key;
+
+    bits = array->layout_symbol_bits;
+    key = 0;
+    for (slot = 0; slot < (int) (8 * sizeof(key)) / bits; slot++) {
+        if (slot >= length) {
+            symbol = (fill) ? (1 << bits) - 1 : 0;
+        }
+        else if ((symbol = array->symbols[(unsigned char) string[slot]]) == 0) {
+            return 0;
+        }
+        key = (key << bits) | symbol;
+    }
+
+    return key;
+}
+
+// Fill the subtree of the layout rooted at a node with consecutive samples,
+// in order, starting with the given sample. Returns the next unused sample.
+static text_position fill_layout(suffix_array* array, text_position node, text_position sample) {
+    text_position position;
+
+    if (node > array->layout_count) {
+        return sample;
+    }
+
+    sample = fill_layout(array, 2 * node, sample);
+
+    // Padding a short suffix with 0s keeps it below every suffix that it starts.
+    position = suffix_at(array, sample * array->layout_spacing);
+    array->layout_keys[node] = make_key(
+        array,
+        array->string + position,
+        array->string_length - position,
+        0
+    );
+    array->layout_samples[node] = sample;
+
+    return fill_layout(array, 2 * node + 1, sample + 1);
+}
+
+// Build the search layout of a suffix array, sampling every spacing-th sorted
+// suffix. Smaller spacings leave less of each search to the suffix array, at
+// the cost of 12 or 16 bytes per sample. A spacing below 1 picks the default.
+flag build_search_layout(suffix_array* array, text_position spacing) {
+    unsigned long long start_time;
+
+    if (array == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    // Don't rebuild an existing layout.
+    if (array->layout_keys != NULL) {
+        return FLAG_SUCCESS;
+    }
+
+    if (spacing < 1) {
+        spacing = SEARCH_LAYOUT_SPACING;
+    }
+    start_time = STATS_TIME();
+
+    // The layout is numbered from 1, so node k has children 2k and 2k + 1.
+    // Symbol 0 is saved for padding.
+    array->layout_symbol_bits = bits_needed(array->alphabet_size + 1);
+    array->layout_spacing = spacing;
+    array->layout_count = (array->string_length - 1) / spacing + 1;
+    array->layout_keys = malloc(sizeof(unsigned long long) * (array->layout_count + 1));
+    array->layout_samples = malloc(sizeof(text_position) * (array->layout_count + 1));
+    if (array->layout_keys == NULL || array->layout_samples == NULL) {
+        destroy_search_layout(array);
+
+        return FLAG_FAILURE;
+    }
+
+    fill_layout(array, 1, 0);
+    STATS_PHASE(PHASE_LAYOUT, start_time);
+
+    return FLAG_SUCCESS;
+}
+
+// Count the samples whose keys are below a key, or, if inclusive is set, no
+// higher than it. The descent has no branches to mispredict, and it fetches
+// the eight nodes three levels down ahead of time, which share a cache line.
+static text_position count_samples_below(suffix_array* array, unsigned long long key, int inclusive) {
+    text_position node;
+
+    node = 1;
+    while (node <= array->layout_count) {
+        __builtin_prefetch(array->layout_keys + 8 * node);
+        node = 2 * node + (
+            (array->layout_keys[node] < key) | (inclusive & (array->layout_keys[node] == key))
+        );
+    }
+
+    // Undo the final run of right turns to find the first sample that
+    // wasn't counted. If there isn't one, every sample was counted.
+    node >>= __builtin_ffsll(~(unsigned long long) node);
+
+    return (node == 0) ? array->layout_count : array->layout_samples[node];
+}
+
+// Narrow down the range of sorted suffixes that could start with a pattern,
+// using only the inline keys. Samples below the pattern's lowest possible key
+// must come before every match, and samples above its highest possible key
+// must come after every match.
+void narrow_search(suffix_array* array, char* pattern, text_position pattern_length, suffix_range* range) {
+    text_position below;
+    text_position through;
+    unsigned long long key;
+
+    // A pattern with a character outside the alphabet can't match anything.
+    if ((key = make_key(array, pattern, pattern_length, 0)) == 0) {
+        range->low = 0;
+        range->high = 0;
+
+        return;
+    }
+
+    below = count_samples_below(array, key, 0);
+    through = count_samples_below(array, make_key(array, pattern, pattern_length, 1), 1);
+
+    range->low = (below == 0) ? 0 : (below - 1) * array->layout_spacing + 1;
+    range->high = (through == array->layout_count)
+        ? array->string_length
+        : through * array->layout_spacing;
+}
+
+// Destroy the search layout of a suffix array, if it has one.
+void destroy_search_layout(suffix_array* array) {
+
+    if (array == NULL) {
+        return;
+    }
+
+    free(array->layout_keys);
+    free(array->layout_samples);
+    array->layout_keys = NULL;
+    array->layout_samples = NULL;
+    array->layout_count = 0;
+}
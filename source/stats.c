@@ -0,0 +1,257 @@
+// Collects counters and timers from the hot paths of building and searching.
+// Nothing is collected until enable_stats is called, and building with
+// NO_STATS compiles every counter out entirely. Searches count into
+// per-thread counters, which are folded into the totals once per search.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "suffix_array.h"
+
+#ifndef NO_STATS
+int stats_enabled;
+build_stats collected_build_stats;
+search_stats collected_search_stats;
+_Thread_local search_counters current_search;
+#endif
+
+// Start collecting statistics. This does nothing in builds without them.
+void enable_stats(void) {
+#ifndef NO_STATS
+    stats_enabled = 1;
+#endif
+}
+
+// Read a monotonic clock in nanoseconds.
+unsigned long long stats_clock(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+#ifndef NO_STATS
+static const char* phase_names[BUILD_PHASES] = {
+    "read", "sort", "lcp", "prefix_table", "layout", "pack", "fm_index"
+};
+static const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+static const char* percentile_names[] = {"p50", "p90", "p99", "p999"};
+
+// Find the histogram bucket of a count. Bucket 0 holds 0, and bucket b holds
+// counts from 2 to the b - 1 up to but not including 2 to the b.
+static int power_bucket(unsigned long long count) {
+    return (count == 0) ? 0 : 64 - __builtin_clzll(count);
+}
+
+// Find the latency bucket of a number of nanoseconds. Every power of two is
+// split into 8 buckets, so a bucket is never more than 12.5% wide.
+static int latency_bucket(unsigned long long nanoseconds) {
+    int exponent;
+
+    if (nanoseconds < 8) {
+        return (int) nanoseconds;
+    }
+    exponent = 63 - __builtin_clzll(nanoseconds);
+
+    return (exponent - 2) * 8 + (int) ((nanoseconds >> (exponent - 3)) & 7);
+}
+
+// Get the smallest number of nanoseconds in a latency bucket.
+static unsigned long long latency_bucket_start(int bucket) {
+    if (bucket < 8) {
+        return bucket;
+    }
+
+    return (8ULL + bucket % 8) << (bucket / 8 - 1);
+}
+
+// Find the latency below which a fraction of all searches finished, to
+// within the width of a bucket.
+static unsigned long long latency_percentile(search_stats* stats, double fraction) {
+    int bucket;
+    unsigned long long seen;
+    unsigned long long target;
+
+    target = (unsigned long long) (fraction * stats->searches);
+    seen = 0;
+    for (bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++) {
+        seen += stats->latency_histogram[bucket];
+        if (seen > target) {
+            return latency_bucket_start(bucket);
+        }
+    }
+
+    return stats->longest_latency;
+}
+
+// Get the most memory this process has held at once, in bytes.
+static unsigned long long peak_memory(void) {
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+    return (unsigned long long) usage.ru_maxrss * 1024;
+}
+#endif
+
+// Add the time since start to the total time of a build phase.
+void record_phase(build_phase phase, unsigned long long start) {
+#ifndef NO_STATS
+    __atomic_fetch_add(&collected_build_stats.phase_nanoseconds[phase], stats_clock() - start, __ATOMIC_RELAXED);
+#else
+    (void) phase;
+    (void) start;
+#endif
+}
+
+// Fold the counters of the search that began at start on this thread into
+// the totals, and reset them for the next search.
+void record_search(unsigned long long start) {
+#ifndef NO_STATS
+    unsigned long long latency;
+    unsigned long long longest;
+
+    latency = stats_clock() - start;
+    __atomic_fetch_add(&collected_search_stats.searches, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&collected_search_stats.probes, current_search.probes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&collected_search_stats.characters, current_search.characters, __ATOMIC_RELAXED);
+    __atomic_fetch_add(
+        &collected_search_stats.character_histogram[power_bucket(current_search.characters)],
+        1,
+        __ATOMIC_RELAXED
+    );
+    __atomic_fetch_add(&collected_search_stats.latency_histogram[latency_bucket(latency)], 1, __ATOMIC_RELAXED);
+    longest = __atomic_load_n(&collected_search_stats.longest_latency, __ATOMIC_RELAXED);
+    while (
+        latency > longest
+        && !__atomic_compare_exchange_n(
+            &collected_search_stats.longest_latency,
+            &longest,
+            latency,
+            1,
+            __ATOMIC_RELAXED,
+            __ATOMIC_RELAXED
+        )
+    );
+    current_search.probes = 0;
+    current_search.characters = 0;
+#else
+    (void) start;
+#endif
+}
+
+// Print every statistic in a form meant for people.
+void print_stats(FILE* stream) {
+#ifndef NO_STATS
+    int phase;
+    int bucket;
+    int percentile;
+    search_stats* search;
+    build_stats* build;
+
+    build = &collected_build_stats;
+    search = &collected_search_stats;
+    fprintf(stream, "Build phases:\n");
+    for (phase = 0; phase < BUILD_PHASES; phase++) {
+        if (build->phase_nanoseconds[phase] != 0) {
+            fprintf(stream, "  %-13s %.6f seconds\n", phase_names[phase], build->phase_nanoseconds[phase] / 1e9);
+        }
+    }
+    fprintf(stream, "Sort passes: %llu\n", build->sort_passes);
+    fprintf(stream, "Queue allocations: %llu\n", build->queue_allocations);
+    fprintf(stream, "Bucket allocations: %llu\n", build->bucket_allocations);
+    fprintf(stream, "Peak memory: %llu bytes\n", peak_memory());
+    fprintf(stream, "Searches: %llu\n", search->searches);
+    if (search->searches == 0) {
+        return;
+    }
+    fprintf(stream, "Probes per search: %.2f\n", (double) search->probes / search->searches);
+    fprintf(stream, "Characters compared per search: %.2f\n", (double) search->characters / search->searches);
+    fprintf(stream, "Characters compared:\n");
+    for (bucket = 0; bucket < STATS_CHARACTER_BUCKETS; bucket++) {
+        if (search->character_histogram[bucket] != 0) {
+            fprintf(
+                stream,
+                "  %-13llu %llu search%s\n",
+                (bucket == 0) ? 0ULL : 1ULL << (bucket - 1),
+                search->character_histogram[bucket],
+                (search->character_histogram[bucket] == 1) ? "" : "es"
+            );
+        }
+    }
+    fprintf(stream, "Search latency:\n");
+    for (percentile = 0; percentile < (int) (sizeof(percentiles) / sizeof(percentiles[0])); percentile++) {
+        fprintf(
+            stream,
+            "  %-13s %llu nanoseconds\n",
+            percentile_names[percentile],
+            latency_percentile(search, percentiles[percentile])
+        );
+    }
+    fprintf(stream, "  %-13s %llu nanoseconds\n", "max", search->longest_latency);
+#else
+    fprintf(stream, "Statistics were compiled out of this build.\n");
+#endif
+}
+
+// Print every statistic as a single line of JSON. The character histogram
+// lists how many searches compared 0 characters, then 1, then 2 or 3, then
+// 4 through 7, and so on, up to the last nonempty bucket.
+void print_stats_json(FILE* stream) {
+#ifndef NO_STATS
+    int phase;
+    int bucket;
+    int last_bucket;
+    int percentile;
+    search_stats* search;
+    build_stats* build;
+
+    build = &collected_build_stats;
+    search = &collected_search_stats;
+    fprintf(stream, "{\"phase_seconds\":{");
+    for (phase = 0; phase < BUILD_PHASES; phase++) {
+        fprintf(stream, "%s\"%s\":%.6f", (phase == 0) ? "" : ",", phase_names[phase], build->phase_nanoseconds[phase] / 1e9);
+    }
+    fprintf(
+        stream,
+        "},\"sort_passes\":%llu,\"queue_allocations\":%llu,\"bucket_allocations\":%llu,\"peak_memory_bytes\":%llu",
+        build->sort_passes,
+        build->queue_allocations,
+        build->bucket_allocations,
+        peak_memory()
+    );
+    fprintf(
+        stream,
+        ",\"searches\":%llu,\"probes\":%llu,\"characters_compared\":%llu,\"character_histogram\":[",
+        search->searches,
+        search->probes,
+        search->characters
+    );
+    last_bucket = -1;
+    for (bucket = 0; bucket < STATS_CHARACTER_BUCKETS; bucket++) {
+        if (search->character_histogram[bucket] != 0) {
+            last_bucket = bucket;
+        }
+    }
+    for (bucket = 0; bucket <= last_bucket; bucket++) {
+        fprintf(stream, "%s%llu", (bucket == 0) ? "" : ",", search->character_histogram[bucket]);
+    }
+    fprintf(stream, "],\"latency_nanoseconds\":{");
+    for (percentile = 0; percentile < (int) (sizeof(percentiles) / sizeof(percentiles[0])); percentile++) {
+        fprintf(
+            stream,
+            "\"%s\":%llu,",
+            percentile_names[percentile],
+            (search->searches == 0) ? 0ULL : latency_percentile(search, percentiles[percentile])
+        );
+    }
+    fprintf(stream, "\"max\":%llu}}\n", search->longest_latency);
+#else
+    fprintf(stream, "{}\n");
+#endif
+}
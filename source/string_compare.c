@@ -0,0 +1,116 @@
+// Provides the comparison kernel behind every search: it finds how many
+// leading characters two strings of known length share, many characters at
+// a time. Null terminators are never needed or looked for.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "suffix_array.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAS_AVX2_KERNEL
+#endif
+
+// Count the leading characters two strings share, one character at a time.
+static text_position scalar_prefix_length(const char* first, const char* second, text_position length) {
+    text_position index;
+
+    for (index = 0; index < length && first[index] == second[index]; index++);
+
+    return index;
+}
+
+#ifdef __SSE2__
+// Count the leading characters two strings share, 16 characters at a time.
+// Each block is compared all at once, and the first mismatch is the lowest
+// clear bit of the equality mask.
+static text_position sse2_prefix_length(const char* first, const char* second, text_position length) {
+    int mask;
+    text_position index;
+
+    for (index = 0; index + 16 <= length; index += 16) {
+        mask = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i*) (first + index)),
+                _mm_loadu_si128((const __m128i*) (second + index))
+            )
+        );
+        if (mask != 0xFFFF) {
+            return index + __builtin_ctz(~mask);
+        }
+    }
+
+    return index + scalar_prefix_length(first + index, second + index, length - index);
+}
+#endif
+
+#ifdef HAS_AVX2_KERNEL
+// Count the leading characters two strings share, 32 characters at a time.
+// This is only called on processors that support AVX2.
+__attribute__((target("avx2")))
+static text_position avx2_prefix_length(const char* first, const char* second, text_position length) {
+    unsigned int mask;
+    text_position index;
+
+    for (index = 0; index + 32 <= length; index += 32) {
+        mask = (unsigned int) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i*) (first + index)),
+                _mm256_loadu_si256((const __m256i*) (second + index))
+            )
+        );
+        if (mask != 0xFFFFFFFF) {
+            return index + __builtin_ctz(~mask);
+        }
+    }
+
+    return index + scalar_prefix_length(first + index, second + index, length - index);
+}
+#endif
+
+// Count how many leading characters two strings share, looking at no more than
+// length characters of either. The widest kernel the processor supports is
+// chosen at run time, so one build runs well everywhere.
+text_position common_prefix_length(const char* first, const char* second, text_position length) {
+#ifdef HAS_AVX2_KERNEL
+    if (length >= 32 && __builtin_cpu_supports("avx2")) {
+        return avx2_prefix_length(first, second, length);
+    }
+#endif
+#ifdef __SSE2__
+    return sse2_prefix_length(first, second, length);
+#else
+    return scalar_prefix_length(first, second, length);
+#endif
+}
+
+// Compare a string to a pattern, both of known length, skipping the first
+// known characters, which must already match. Characters compare as unsigned
+// bytes, and a string that runs out first is the lower one. Returns success
+// if the string starts with the pattern, and saves the number of matching
+// characters in matched.
+flag compare_prefix(
+    const char* string,
+    text_position string_length,
+    const char* pattern,
+    text_position pattern_length,
+    text_position known,
+    text_position* matched
+) {
+    text_position limit;
+
+    limit = (string_length < pattern_length) ? string_length : pattern_length;
+    *matched = known + common_prefix_length(string + known, pattern + known, limit - known);
+    STATS_SEARCH_ADD(characters, *matched - known + (*matched < limit));
+
+    if (*matched == pattern_length) {
+        return FLAG_SUCCESS;
+    }
+    else if (*matched == string_length) {
+        return FLAG_STRING_LOWER;
+    }
+
+    return ((unsigned char) string[*matched] < (unsigned char) pattern[*matched])
+        ? FLAG_STRING_LOWER
+        : FLAG_PATTERN_LOWER;
+}
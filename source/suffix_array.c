@@ -5,18 +5,41 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "suffix_array.h"
 
-// Get the index of a character in an array, based on its position in the Latin alphabet.
-int index_of_character(char character) {
-    if (character >= 'A' && character <= 'Z') {
-        return character - 'A';
-    }
-    else if (character >= 'a' && character <= 'z') {
-        return character - 'a';
+// Get the index of a character in a suffix array's alphabet. The alphabet holds
+// only the characters that appear in the string, in byte order.
+int index_of_character(suffix_array* array, char character) {
+    int symbol;
+
+    symbol = array->symbols[(unsigned char) character];
+
+    return (symbol == 0) ? FLAG_FAILURE : symbol - 1;
+}
+
+// Shrink the alphabet of a suffix array down to the characters that appear in
+// its string. Sorting then needs one bucket per character that is actually
+// used, such as 4 for DNA, rather than one for every possible byte.
+void build_alphabet(suffix_array* array) {
+    int byte;
+    text_position position;
+
+    memset(array->symbols, 0, sizeof(array->symbols));
+    for (position = 0; position < array->string_length; position++) {
+        array->symbols[(unsigned char) array->string[position]] = 1;
     }
-    else {
-        return FLAG_FAILURE;
+
+    // Number the characters that appear from 1 upwards, leaving 0 to
+    // mark characters that don't appear at all.
+    array->alphabet_size = 0;
+    for (byte = 0; byte < ALPHABET_SIZE; byte++) {
+        if (array->symbols[byte]) {
+            array->symbols[byte] = ++array->alphabet_size;
+        }
     }
 }
 
@@ -28,9 +51,78 @@ int is_alphabetic(char character) {
     );
 }
 
-// Determine if a string contains a pattern.
+// Copy the characters worth keeping from a block of input to the end of a
+// string, returning how many were kept. Unless every byte is wanted, only
+// alphabetic characters are kept. Null bytes can never be kept, because they
+// would end the string.
+size_t filter_characters(const char* input, size_t length, char* output, int keep_all) {
+    size_t kept;
+    size_t index;
+    const char* null_byte;
+#ifdef __SSE2__
+    int mask;
+    __m128i block;
+    __m128i folded;
+#endif
+
+    // Keep everything between null bytes. The search for null bytes and the
+    // copies are both vectorized by the C library.
+    kept = 0;
+    if (keep_all) {
+        while (length > 0) {
+            null_byte = memchr(input, '\0', length);
+            index = (null_byte == NULL) ? length : (size_t) (null_byte - input);
+            memcpy(output + kept, input, index);
+            kept += index;
+            index += (null_byte != NULL);
+            input += index;
+            length -= index;
+        }
+
+        return kept;
+    }
+
+    index = 0;
+#ifdef __SSE2__
+    // Check 16 characters at a time. Folding to lowercase leaves every letter
+    // between 'a' and 'z', while bytes above 127 compare as negative. Blocks
+    // that are entirely alphabetic, like most lines of a DNA file, are copied
+    // whole. Blocks with anything else in them are filtered one at a time.
+    for (; index + 16 <= length; index += 16) {
+        block = _mm_loadu_si128((const __m128i*) (input + index));
+        folded = _mm_or_si128(block, _mm_set1_epi8(0x20));
+        mask = _mm_movemask_epi8(
+            _mm_and_si128(
+                _mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+                _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1))
+            )
+        );
+        if (mask == 0xFFFF) {
+            _mm_storeu_si128((__m128i*) (output + kept), block);
+            kept += 16;
+        }
+        else {
+            for (; mask != 0; mask &= mask - 1) {
+                output[kept++] = input[index + __builtin_ctz(mask)];
+            }
+        }
+    }
+#endif
+
+    // Filter whatever is left without branching on each character.
+    for (; index < length; index++) {
+        output[kept] = input[index];
+        kept += is_alphabetic(input[index]);
+    }
+
+    return kept;
+}
+
+// Determine if a string starts with a pattern. If it doesn't, the flag tells
+// which of the two is alphabetically lower.
 flag contains(char* string, char* pattern) {
-    int char_index;
+    text_position matched;
+    text_position pattern_length;
 
     if (string == NULL) {
         return (pattern == NULL) ? FLAG_SUCCESS : FLAG_STRING_LOWER;
@@ -39,44 +131,81 @@ flag contains(char* string, char* pattern) {
         return FLAG_PATTERN_LOWER;
     }
 
-    // Compare all elements in both char arrays. If there is a mismatch,
-    // throw the appropriate flag.
-    char_index = 0;
-    while (string[char_index] != '\0' && pattern[char_index] != '\0') {
-        if (string[char_index] != pattern[char_index]) {
-            if (string[char_index] < pattern[char_index]) {
-                return FLAG_STRING_LOWER;
-            }
-            else {
-                return FLAG_PATTERN_LOWER;
-            }
-        }
-        else {
-            char_index++;
-        }
-    }
+    // The string only needs to be measured as far as the pattern reaches.
+    pattern_length = strlen(pattern);
 
-    // At this point, every character has matched in the pattern and the string.
-    // If the pattern is finished, return success! Otherwise the string must be
-    // finished, so the string has lower alphabetic precedence than the pattern.
-    return (pattern[char_index] == '\0') ? FLAG_SUCCESS : FLAG_STRING_LOWER;
+    return compare_prefix(
+        string,
+        strnlen(string, pattern_length),
+        pattern,
+        pattern_length,
+        0,
+        &matched
+    );
 }
 
-// Create a new suffix array with alphabetically suffixes.
+// Create a new suffix array with alphabetically sorted suffixes.
 suffix_array* new_suffix_array(char* string) {
-    int characters;
-    int suffix_index;
+    return new_suffix_array_using(string, SORT_INDUCED, 1);
+}
+
+// Sort the suffixes of a new suffix array, whose string is already in place,
+// with the chosen method. The thread count only matters to parallel sorting,
+// where a count below 1 means one thread per online processor.
+static flag sort_new_suffix_array(suffix_array* array, sort_method method, int threads) {
+    flag result;
+    text_position suffix_index;
+    unsigned long long start_time;
+
+    // Create the suffix position integer array.
+    if ((array->suffixes = malloc(sizeof(text_position) * array->string_length)) == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    // Initialize all suffix positions in the suffix array to their respective
+    // start positions in the string. These suffix positions are not
+    // alphabetically sorted. That step is next!
+    for (suffix_index = 0; suffix_index < array->string_length; suffix_index++) {
+        array->suffixes[suffix_index] = suffix_index;
+    }
+    build_alphabet(array);
+
+    // Sort the suffix positions in the suffix array alphabetically.
+    start_time = STATS_TIME();
+    if (method == SORT_RADIX) {
+        result = sort_suffixes_alphabetically(array);
+    }
+    else if (method == SORT_COUNTING) {
+        result = sort_suffixes_by_counting(array);
+    }
+    else if (method == SORT_PARALLEL) {
+        result = sort_suffixes_in_parallel(array, threads);
+    }
+    else {
+        result = sort_suffixes_by_induction(array);
+    }
+    STATS_PHASE(PHASE_SORT, start_time);
+
+    return result;
+}
+
+// Create a new suffix array, sorting the suffixes with the chosen method. The
+// thread count only matters to parallel sorting, where a count below 1 means
+// one thread per online processor.
+suffix_array* new_suffix_array_using(char* string, sort_method method, int threads) {
+    size_t characters;
     suffix_array* array;
 
     if (string == NULL || string[0] == '\0') {
         return NULL;
     }
 
-    // Ensure that all characters are alphabetic, and count the number of characters.
-    // No non-alphabetic characters are allowed in this implementation.
+    // Count the number of characters. Any byte but the null terminator is
+    // allowed. The string must be short enough that every position, plus one
+    // more for the sorting sentinel, fits in a text_position.
     characters = 0;
     while (string[characters] != '\0') {
-        if (!is_alphabetic(string[characters])) {
+        if (characters >= TEXT_POSITION_MAX - 1) {
             return NULL;
         }
         else {
@@ -85,7 +214,7 @@ suffix_array* new_suffix_array(char* string) {
     }
 
     // Create the suffix array container struct.
-    if ((array = malloc(sizeof(suffix_array))) == NULL) {
+    if ((array = calloc(1, sizeof(suffix_array))) == NULL) {
         return NULL;
     }
 
@@ -97,25 +226,37 @@ suffix_array* new_suffix_array(char* string) {
         return NULL;
     }
 
-    // Create the suffix position integer array.
-    if ((array->suffixes = malloc(sizeof(int) * characters)) == NULL) {
+    // Copy the string into the container struct, and save its length.
+    strcpy(array->string, string);
+    array->string_length = characters;
+    if (sort_new_suffix_array(array, method, threads) == FLAG_FAILURE) {
         destroy_suffix_array(array);
 
         return NULL;
     }
 
-    // Copy the string into the container struct. Also save the string length
-    // and initialize all suffix positions in the suffix array to their respective
-    // start positions in the string. These suffix positions are not alphabetically
-    // sorted. That step is next!
-    strcpy(array->string, string);
-    array->string_length = characters;
-    for (suffix_index = 0; suffix_index < array->string_length; suffix_index++) {
-        array->suffixes[suffix_index] = suffix_index;
+    return array;
+}
+
+// Create a new suffix array over the first length characters of a string
+// without copying them, sorting the suffixes with the chosen method. The
+// characters don't need a null terminator after them, but they must not
+// change or move while the suffix array is in use, and they aren't freed
+// along with it.
+suffix_array* new_borrowed_suffix_array(char* string, text_position length, sort_method method, int threads) {
+    suffix_array* array;
+
+    if (string == NULL || length < 1 || length >= TEXT_POSITION_MAX - 1) {
+        return NULL;
     }
 
-    // Sort the suffix positions in the suffix array alphabetically.
-    if (sort_suffixes_alphabetically(array) == FLAG_FAILURE) {
+    if ((array = calloc(1, sizeof(suffix_array))) == NULL) {
+        return NULL;
+    }
+    array->string = string;
+    array->string_length = length;
+    array->borrows_string = 1;
+    if (sort_new_suffix_array(array, method, threads) == FLAG_FAILURE) {
         destroy_suffix_array(array);
 
         return NULL;
@@ -126,13 +267,13 @@ suffix_array* new_suffix_array(char* string) {
 
 // Use radix sort to sort the suffixes in a suffix array alphabetically.
 flag sort_suffixes_alphabetically(suffix_array* array) {
-    int offset;
     flag result;
     int queue_index;
-    int char_target;
-    int suffix_index;
+    text_position offset;
+    text_position char_target;
+    text_position suffix_index;
     integer_queue* unsorted_queue;
-    integer_queue* queues[ALPHABET_SIZE];
+    integer_queue* queues[ALPHABET_SIZE] = {NULL};
 
     if (array == NULL) {
         return FLAG_FAILURE;
@@ -144,13 +285,13 @@ flag sort_suffixes_alphabetically(suffix_array* array) {
         return FLAG_FAILURE;
     }
 
-    // Create ALPHABET_SIZE integer queues in an array for radix sort.
-    for (queue_index = 0; queue_index < ALPHABET_SIZE; queue_index++) {
+    // Create an integer queue for every character in the alphabet for radix sort.
+    for (queue_index = 0; queue_index < array->alphabet_size; queue_index++) {
 
         // If a call to create a new queue fails, free all
         // previously created queues and fail.
         if ((queues[queue_index] = new_integer_queue()) == NULL) {
-            destroy_integer_queues(queues, ALPHABET_SIZE);
+            destroy_integer_queues(queues, array->alphabet_size);
             destroy_integer_queue(unsorted_queue);
 
             return FLAG_FAILURE;
@@ -169,12 +310,13 @@ flag sort_suffixes_alphabetically(suffix_array* array) {
         // For each suffix: if the offset is too big, place that suffix in the
         // unsorted queue, otherwise placee the suffix in the appropriate queue that
         // corresponds to that suffix's offset character.
+        STATS_BUILD_ADD(sort_passes, 1);
         for (suffix_index = 0; suffix_index < array->string_length; suffix_index++) {
             char_target = array->suffixes[suffix_index] + offset;
             if (char_target >= array->string_length) {
                 result = enqueue(unsorted_queue, array->suffixes[suffix_index]);
                 if (result == FLAG_FAILURE) {
-                    destroy_integer_queues(queues, ALPHABET_SIZE);
+                    destroy_integer_queues(queues, array->alphabet_size);
                     destroy_integer_queue(unsorted_queue);
 
                     return FLAG_FAILURE;
@@ -182,11 +324,11 @@ flag sort_suffixes_alphabetically(suffix_array* array) {
             }
             else {
                 result = enqueue(
-                    queues[index_of_character(array->string[char_target])],
+                    queues[index_of_character(array, array->string[char_target])],
                     array->suffixes[suffix_index]
                 );
                 if (result == FLAG_FAILURE) {
-                    destroy_integer_queues(queues, ALPHABET_SIZE);
+                    destroy_integer_queues(queues, array->alphabet_size);
                     destroy_integer_queue(unsorted_queue);
 
                     return FLAG_FAILURE;
@@ -204,7 +346,7 @@ flag sort_suffixes_alphabetically(suffix_array* array) {
 
         // Dequeue all contents from the sorted queues back into the suffixes
         // array, in order.
-        for (queue_index = 0; queue_index < ALPHABET_SIZE; queue_index++) {
+        for (queue_index = 0; queue_index < array->alphabet_size; queue_index++) {
             while(!is_empty(queues[queue_index])) {
                 array->suffixes[suffix_index] = dequeue(queues[queue_index]);
                 suffix_index++;
@@ -217,44 +359,669 @@ flag sort_suffixes_alphabetically(suffix_array* array) {
 
     // Clean up after yourself!
     destroy_integer_queue(unsorted_queue);
-    destroy_integer_queues(queues, ALPHABET_SIZE);
+    destroy_integer_queues(queues, array->alphabet_size);
+
+    return FLAG_SUCCESS;
+}
+
+// Use radix sort with counting sort buckets to sort the suffixes in a suffix
+// array alphabetically. This performs the same passes as the queue-based radix
+// sort above, but every pass is a histogram, a prefix sum, and a scatter into
+// a scratch buffer that is allocated once up front.
+flag sort_suffixes_by_counting(suffix_array* array) {
+    int bucket;
+    text_position sum;
+    text_position offset;
+    text_position char_target;
+    text_position suffix_index;
+    text_position* sorted;
+    text_position* unsorted;
+    text_position* swap;
+    text_position buckets[ALPHABET_SIZE + 1];
+
+    if (array == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    if ((sorted = malloc(sizeof(text_position) * array->string_length)) == NULL) {
+        return FLAG_FAILURE;
+    }
+    STATS_BUILD_ADD(bucket_allocations, 1);
+
+    // Bucket 0 plays the role of the unsorted queue: it holds suffixes that
+    // are too short to have a character at the current offset. Every other
+    // bucket is one past the character's alphabet index.
+    unsorted = array->suffixes;
+    offset = array->string_length - 1;
+    while (offset >= 0) {
+
+        // Count how many suffixes land in each bucket.
+        STATS_BUILD_ADD(sort_passes, 1);
+        for (bucket = 0; bucket <= array->alphabet_size; bucket++) {
+            buckets[bucket] = 0;
+        }
+        for (suffix_index = 0; suffix_index < array->string_length; suffix_index++) {
+            char_target = unsorted[suffix_index] + offset;
+            if (char_target >= array->string_length) {
+                buckets[0]++;
+            }
+            else {
+                buckets[index_of_character(array, array->string[char_target]) + 1]++;
+            }
+        }
+
+        // Turn the counts into the starting position of each bucket.
+        sum = 0;
+        for (bucket = 0; bucket <= array->alphabet_size; bucket++) {
+            sum += buckets[bucket];
+            buckets[bucket] = sum - buckets[bucket];
+        }
+
+        // Scatter the suffixes into their buckets, preserving their relative
+        // order so that each pass is stable.
+        for (suffix_index = 0; suffix_index < array->string_length; suffix_index++) {
+            char_target = unsorted[suffix_index] + offset;
+            if (char_target >= array->string_length) {
+                bucket = 0;
+            }
+            else {
+                bucket = index_of_character(array, array->string[char_target]) + 1;
+            }
+            sorted[buckets[bucket]++] = unsorted[suffix_index];
+        }
+
+        // The freshly sorted buffer becomes the input of the next pass.
+        swap = unsorted;
+        unsorted = sorted;
+        sorted = swap;
+
+        offset--;
+    }
+
+    // After an odd number of passes the result lives in the scratch buffer.
+    if (unsorted != array->suffixes) {
+        for (suffix_index = 0; suffix_index < array->string_length; suffix_index++) {
+            array->suffixes[suffix_index] = unsorted[suffix_index];
+        }
+        sorted = unsorted;
+    }
+    free(sorted);
+
+    return FLAG_SUCCESS;
+}
+
+// Use induced sorting to sort the suffixes in a suffix array alphabetically
+// in linear time. The result is identical to the radix sort above.
+flag sort_suffixes_by_induction(suffix_array* array) {
+    text_position* text;
+    text_position* suffixes;
+    text_position text_index;
+
+    if (array == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    // Translate the string into alphabet indices shifted up by one, so that
+    // a unique 0 sentinel can mark the end. The sentinel sorts before every
+    // character, just like a suffix that runs out of characters in radix sort.
+    if ((text = malloc(sizeof(text_position) * (array->string_length + 1))) == NULL) {
+        return FLAG_FAILURE;
+    }
+    if ((suffixes = malloc(sizeof(text_position) * (array->string_length + 1))) == NULL) {
+        free(text);
+
+        return FLAG_FAILURE;
+    }
+    for (text_index = 0; text_index < array->string_length; text_index++) {
+        text[text_index] = index_of_character(array, array->string[text_index]) + 1;
+    }
+    text[array->string_length] = 0;
+
+    if (induced_sort(text, suffixes, array->string_length + 1, array->alphabet_size + 1) == FLAG_FAILURE) {
+        free(suffixes);
+        free(text);
+
+        return FLAG_FAILURE;
+    }
+
+    // The sentinel suffix always sorts first, so skip it.
+    for (text_index = 0; text_index < array->string_length; text_index++) {
+        array->suffixes[text_index] = suffixes[text_index + 1];
+    }
+
+    free(suffixes);
+    free(text);
+
+    return FLAG_SUCCESS;
+}
+
+// Retrieve the starting position of the suffix at an index of the sorted suffixes.
+text_position suffix_at(suffix_array* array, text_position index) {
+    unsigned char* packed;
+
+    if (array->packed_suffixes == NULL) {
+        return array->suffixes[index];
+    }
+    else if (array->suffix_bits != 0) {
+        return bit_packed_value(array->packed_suffixes, index, array->suffix_bits);
+    }
+
+    // Packed suffixes are stored little-endian, one byte at a time.
+    packed = array->packed_suffixes + (size_t) index * PACKED_SUFFIX_SIZE;
+
+    return (text_position) (
+        (unsigned long long) packed[0]
+        | (unsigned long long) packed[1] << 8
+        | (unsigned long long) packed[2] << 16
+        | (unsigned long long) packed[3] << 24
+        | (unsigned long long) packed[4] << 32
+    );
+}
+
+// Determine how many bits it takes to store every value below a limit.
+int bits_needed(text_position limit) {
+    int bits;
+
+    bits = 1;
+    while (bits < PACKED_BITS_MAX && (unsigned long long) (limit - 1) >> bits != 0) {
+        bits++;
+    }
+
+    return bits;
+}
+
+// Determine how many bytes it takes to bit pack a number of values. There
+// are 8 bytes to spare at the end, so every value can be read with a single
+// unaligned 8-byte load.
+size_t bit_packed_size(text_position count, int bits) {
+    return ((size_t) count * bits + 7) / 8 + sizeof(unsigned long long);
+}
+
+// Read a value from an array of values that are bit packed little-endian,
+// with the first value starting at the lowest bit of the first byte.
+text_position bit_packed_value(unsigned char* values, text_position index, int bits) {
+    size_t offset;
+    unsigned long long word;
+
+    offset = (size_t) index * bits;
+    memcpy(&word, values + offset / 8, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+
+    return (text_position) ((word >> (offset % 8)) & ((1ULL << bits) - 1));
+}
+
+// Pack the sorted suffixes of a suffix array into PACKED_SUFFIX_SIZE bytes
+// apiece, which is enough for strings of up to a terabyte. Packing happens in
+// place, so it never needs more memory than the unpacked suffixes. Builds
+// whose positions already fit in PACKED_SUFFIX_SIZE bytes are left alone,
+// even if their suffixes live in a mapped index file. Otherwise, mapped
+// suffixes can't be rewritten, so they can't be packed.
+flag pack_suffixes(suffix_array* array) {
+    int byte;
+    text_position index;
+    text_position suffix;
+    unsigned char* packed;
+    unsigned char* resized;
+    unsigned long long start_time;
+
+    if (array == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    if (array->packed_suffixes != NULL || sizeof(text_position) <= PACKED_SUFFIX_SIZE) {
+        return FLAG_SUCCESS;
+    }
+
+    if (is_mapped(array, array->suffixes)) {
+        return FLAG_FAILURE;
+    }
+
+    if ((unsigned long long) array->string_length >> (8 * PACKED_SUFFIX_SIZE) != 0) {
+        return FLAG_FAILURE;
+    }
+
+    // Every packed suffix ends before the unpacked suffix that follows it
+    // begins, so each one can be read before its bytes are overwritten.
+    start_time = STATS_TIME();
+    packed = (unsigned char*) array->suffixes;
+    for (index = 0; index < array->string_length; index++) {
+        suffix = array->suffixes[index];
+        for (byte = 0; byte < PACKED_SUFFIX_SIZE; byte++) {
+            packed[(size_t) index * PACKED_SUFFIX_SIZE + byte] = (unsigned char) (suffix >> (8 * byte));
+        }
+    }
+
+    // Give back the memory that packing freed up. If the system refuses, the
+    // original allocation still holds the packed suffixes just fine.
+    if ((resized = realloc(packed, (size_t) array->string_length * PACKED_SUFFIX_SIZE)) != NULL) {
+        packed = resized;
+    }
+    array->packed_suffixes = packed;
+    array->suffixes = NULL;
+    STATS_PHASE(PHASE_PACK, start_time);
+
+    return FLAG_SUCCESS;
+}
+
+// Pack the sorted suffixes of a suffix array into as few bits as the longest
+// position needs, such as 27 bits for a hundred million characters. Like
+// pack_suffixes, this happens in place and works in every build. Suffixes
+// that were already bit packed are left alone, but mapped suffixes can't be
+// rewritten.
+flag bit_pack_suffixes(suffix_array* array) {
+    int bits;
+    int pending_bits;
+    size_t size;
+    size_t written;
+    text_position index;
+    unsigned long long pending;
+    unsigned char* packed;
+    unsigned char* resized;
+    unsigned long long start_time;
+
+    if (array == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    if (array->packed_suffixes != NULL) {
+        return (array->suffix_bits != 0) ? FLAG_SUCCESS : FLAG_FAILURE;
+    }
+
+    if (is_mapped(array, array->suffixes)) {
+        return FLAG_FAILURE;
+    }
+
+    bits = bits_needed(array->string_length);
+    if ((unsigned long long) (array->string_length - 1) >> bits != 0) {
+        return FLAG_FAILURE;
+    }
+    start_time = STATS_TIME();
+
+    // Tiny arrays can need more room packed than unpacked, because of
+    // the spare bytes at the end. Grow those before packing.
+    size = bit_packed_size(array->string_length, bits);
+    packed = (unsigned char*) array->suffixes;
+    if (size > sizeof(text_position) * array->string_length) {
+        if ((packed = realloc(packed, size)) == NULL) {
+            return FLAG_FAILURE;
+        }
+        array->suffixes = (text_position*) packed;
+    }
+
+    // Stream the bits out a byte at a time. A byte is only written once all
+    // of its bits are known, and it always lies before the first suffix
+    // that hasn't been read yet.
+    written = 0;
+    pending = 0;
+    pending_bits = 0;
+    for (index = 0; index < array->string_length; index++) {
+        pending |= (unsigned long long) array->suffixes[index] << pending_bits;
+        pending_bits += bits;
+        while (pending_bits >= 8) {
+            packed[written++] = (unsigned char) pending;
+            pending >>= 8;
+            pending_bits -= 8;
+        }
+    }
+    if (pending_bits > 0) {
+        packed[written++] = (unsigned char) pending;
+    }
+    memset(packed + written, 0, size - written);
+
+    if ((resized = realloc(packed, size)) != NULL) {
+        packed = resized;
+    }
+    array->packed_suffixes = packed;
+    array->suffix_bits = bits;
+    array->suffixes = NULL;
+    STATS_PHASE(PHASE_PACK, start_time);
+
+    return FLAG_SUCCESS;
+}
+
+// Find the first sorted suffix between low and high that is not alphabetically
+// lower than the pattern, or, if upper is set, the first one that is higher than
+// the pattern. Suffixes that start with the pattern count as equal to it. Every
+// suffix strictly between the bounds must already be known to match the first
+// known characters of the pattern. The search remembers how many characters of
+// the pattern match the suffixes at its low and high bounds. Every suffix
+// between the bounds shares at least the smaller of the two, so those characters
+// are never compared again. If the suffix array has LCP tables and the search
+// covers the whole array, a probe can often be decided without comparing any
+// characters at all. The number of matched characters at the returned suffix
+// is saved in matched.
+static text_position find_bound(
+    suffix_array* array,
+    char* pattern,
+    text_position pattern_length,
+    int upper,
+    text_position low,
+    text_position high,
+    text_position known,
+    text_position* matched
+) {
+    int decided;
+    int use_tables;
+    flag comparison;
+    text_position mid;
+    text_position match;
+    text_position position;
+    text_position low_match;
+    text_position high_match;
+
+    // The LCP tables only hold the probes of a search over the whole array,
+    // starting from nothing.
+    use_tables = (
+        array->left_lcp != NULL
+        && low == -1
+        && high == array->string_length
+        && known == 0
+    );
+    low_match = known;
+    high_match = known;
+    while (high - low > 1) {
+        mid = low + (high - low) / 2;
+        decided = 0;
+        STATS_SEARCH_ADD(probes, 1);
+
+        // The LCP of a bound and the midpoint tells whether the midpoint
+        // diverges from the pattern before, after, or exactly where that
+        // bound does. Only a tie needs character comparisons.
+        if (use_tables && low_match >= high_match) {
+            match = low_match;
+            if (array->left_lcp[mid] > low_match) {
+                low = mid;
+                decided = 1;
+            }
+            else if (array->left_lcp[mid] < low_match) {
+                high = mid;
+                high_match = array->left_lcp[mid];
+                decided = 1;
+            }
+        }
+        else if (use_tables) {
+            match = high_match;
+            if (array->right_lcp[mid] > high_match) {
+                high = mid;
+                decided = 1;
+            }
+            else if (array->right_lcp[mid] < high_match) {
+                low = mid;
+                low_match = array->right_lcp[mid];
+                decided = 1;
+            }
+        }
+        else {
+            match = (low_match < high_match) ? low_match : high_match;
+        }
+
+        if (!decided) {
+
+            // Compare the rest of the pattern against the midpoint suffix. A
+            // suffix that starts with the pattern belongs below the upper
+            // bound but above the lower bound.
+            position = suffix_at(array, mid);
+            comparison = compare_prefix(
+                array->string + position,
+                array->string_length - position,
+                pattern,
+                pattern_length,
+                match,
+                &match
+            );
+            if (
+                (comparison == FLAG_SUCCESS && !upper)
+                || comparison == FLAG_PATTERN_LOWER
+            ) {
+                high = mid;
+                high_match = match;
+            }
+            else {
+                low = mid;
+                low_match = match;
+            }
+        }
+    }
+
+    *matched = high_match;
+
+    return high;
 }
 
 // Perform a binary search on the suffix array to check for a pattern in the string.
-int search(suffix_array* array, char* pattern) {
-    int low;
-    int mid;
-    int high;
-    flag result;
+text_position search(suffix_array* array, char* pattern) {
+    suffix_range range;
 
-    if (array == NULL || pattern == NULL || pattern[0] == '\0') {
+    // The first suffix that is not lower than the pattern contains
+    // the pattern, if any suffix does.
+    if (search_range(array, pattern, &range) == FLAG_FAILURE || range.low == range.high) {
         return FLAG_FAILURE;
     }
 
-    // The classic binary search algorithm.
-    low = 0;
-    high = array->string_length - 1;
-    while (low <= high) {
-        mid = high - ((high - low) / 2);
+    return suffix_at(array, range.low);
+}
 
-        result = contains(array->string + array->suffixes[mid], pattern);
-        if (result == FLAG_SUCCESS) {
-            return array->suffixes[mid];
+// Find the range of sorted suffixes that start with a pattern. The range
+// is empty if the pattern doesn't appear in the string. With a prefix table,
+// short patterns are answered without searching at all, and longer ones only
+// search the suffixes that share their first prefix_length characters. With
+// a search layout, the search only covers the suffixes between two samples.
+// With a query cache, patterns searched before are answered from it.
+flag search_range(suffix_array* array, char* pattern, suffix_range* range) {
+    text_position low;
+    text_position high;
+    text_position known;
+    text_position matched;
+    text_position pattern_length;
+    suffix_range prefixes;
+    suffix_range candidates;
+    unsigned long long start_time;
+
+    if (array == NULL || pattern == NULL || pattern[0] == '\0' || range == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    start_time = STATS_TIME();
+    pattern_length = strlen(pattern);
+    low = -1;
+    high = array->string_length;
+    known = 0;
+
+    // Patterns that the prefix table answers outright are too cheap to
+    // cache, so they never reach the cache at all.
+    if (array->prefix_table != NULL) {
+        prefix_range(array, pattern, pattern_length, &prefixes);
+        if (pattern_length <= array->prefix_length || prefixes.low == prefixes.high) {
+            *range = prefixes;
+            STATS_SEARCH(start_time);
+
+            return FLAG_SUCCESS;
         }
-        else if (result == FLAG_STRING_LOWER) {
-            low = mid + 1;
+        low = prefixes.low - 1;
+        high = prefixes.high;
+        known = array->prefix_length;
+    }
+    if (array->cache != NULL && find_cached_range(array->cache, pattern, pattern_length, range)) {
+        STATS_SEARCH(start_time);
+
+        return FLAG_SUCCESS;
+    }
+    if (array->layout_keys != NULL) {
+        narrow_search(array, pattern, pattern_length, &candidates);
+        if (candidates.low - 1 > low) {
+            low = candidates.low - 1;
+        }
+        if (candidates.high < high) {
+            high = candidates.high;
+        }
+    }
+
+    range->low = find_bound(array, pattern, pattern_length, 0, low, high, known, &matched);
+    if (range->low == high || matched < pattern_length) {
+        range->high = range->low;
+    }
+    else {
+        range->high = find_bound(array, pattern, pattern_length, 1, low, high, known, &matched);
+    }
+    if (array->cache != NULL) {
+        cache_range(array->cache, pattern, pattern_length, range);
+    }
+    STATS_SEARCH(start_time);
+
+    return FLAG_SUCCESS;
+}
+
+// Narrow a range of sorted suffixes down to the ones that continue with the
+// rest of a pattern. Every suffix in the range must already be known to match
+// the first known characters, which aren't compared again, even if they
+// differ from the pattern's.
+flag narrow_range(suffix_array* array, char* pattern, text_position known, suffix_range* range) {
+    text_position low;
+    text_position high;
+    text_position matched;
+    text_position pattern_length;
+
+    if (array == NULL || pattern == NULL || range == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    pattern_length = strlen(pattern);
+    if (known >= pattern_length || range->low >= range->high) {
+        return FLAG_SUCCESS;
+    }
+    low = range->low - 1;
+    high = range->high;
+    range->low = find_bound(array, pattern, pattern_length, 0, low, high, known, &matched);
+    if (range->low == high || matched < pattern_length) {
+        range->high = range->low;
+    }
+    else {
+        range->high = find_bound(array, pattern, pattern_length, 1, low, high, known, &matched);
+    }
+
+    return FLAG_SUCCESS;
+}
+
+// Count the number of times a pattern appears in the string.
+text_position count_occurrences(suffix_array* array, char* pattern) {
+    suffix_range range;
+
+    if (search_range(array, pattern, &range) == FLAG_FAILURE) {
+        return FLAG_FAILURE;
+    }
+
+    return range.high - range.low;
+}
+
+// Retrieve the next position in a range of sorted suffixes, shrinking the range.
+// The positions come out in sorted suffix order, not string order.
+text_position next_occurrence(suffix_array* array, suffix_range* range) {
+
+    if (array == NULL || range == NULL || range->low >= range->high) {
+        return FLAG_FAILURE;
+    }
+
+    return suffix_at(array, range->low++);
+}
+
+// Write out a dump buffer, emptying it.
+static flag flush_dump(FILE* stream, char* buffer, size_t* used) {
+
+    if (*used > 0 && fwrite(buffer, 1, *used, stream) != *used) {
+        return FLAG_FAILURE;
+    }
+    *used = 0;
+
+    return FLAG_SUCCESS;
+}
+
+// Write the suffixes of a suffix array to a stream, one per line, in sorted
+// order or in string order. Every suffix can be written in full, cut down to
+// at most length characters, or as just its starting position. Lines are
+// gathered in a large buffer, so the stream sees a few big writes rather
+// than one per suffix.
+flag dump_suffixes(suffix_array* array, FILE* stream, int sorted, dump_mode mode, text_position length) {
+    int digits;
+    char* buffer;
+    size_t used;
+    text_position index;
+    text_position position;
+    text_position written;
+    unsigned long long value;
+    char number[24];
+
+    if (array == NULL || stream == NULL) {
+        return FLAG_FAILURE;
+    }
+    if (mode == DUMP_NONE) {
+        return FLAG_SUCCESS;
+    }
+
+    if ((buffer = malloc(DUMP_BUFFER_SIZE)) == NULL) {
+        return FLAG_FAILURE;
+    }
+    used = 0;
+    for (index = 0; index < array->string_length; index++) {
+        position = (sorted) ? suffix_at(array, index) : index;
+
+        // Spell out the position backwards, then copy it forwards.
+        if (mode == DUMP_INDICES) {
+            if (used + sizeof(number) > DUMP_BUFFER_SIZE && flush_dump(stream, buffer, &used) == FLAG_FAILURE) {
+                free(buffer);
+
+                return FLAG_FAILURE;
+            }
+            value = position;
+            digits = 0;
+            do {
+                number[digits++] = '0' + value % 10;
+                value /= 10;
+            } while (value != 0);
+            while (digits > 0) {
+                buffer[used++] = number[--digits];
+            }
+            buffer[used++] = '\n';
+            continue;
+        }
+
+        // Suffixes too long for the buffer skip it entirely.
+        written = array->string_length - position;
+        if (mode == DUMP_TRUNCATED && written > length) {
+            written = length;
+        }
+        if (used + written + 1 > DUMP_BUFFER_SIZE && flush_dump(stream, buffer, &used) == FLAG_FAILURE) {
+            free(buffer);
+
+            return FLAG_FAILURE;
+        }
+        if ((size_t) written + 1 > DUMP_BUFFER_SIZE) {
+            if (fwrite(array->string + position, 1, written, stream) != (size_t) written || fputc('\n', stream) == EOF) {
+                free(buffer);
+
+                return FLAG_FAILURE;
+            }
         }
         else {
-            high = mid - 1;
+            memcpy(buffer + used, array->string + position, written);
+            used += written;
+            buffer[used++] = '\n';
         }
     }
 
-    return FLAG_FAILURE;
+    if (flush_dump(stream, buffer, &used) == FLAG_FAILURE) {
+        free(buffer);
+
+        return FLAG_FAILURE;
+    }
+    free(buffer);
+
+    return FLAG_SUCCESS;
 }
 
 // Print the unsorted suffixes in a suffix array.
 void print_unsorted_suffixes(suffix_array* array) {
-    int suffix_offset;
 
     if (array == NULL) {
         printf("Suffix array is NULL!\n");
@@ -262,35 +1029,25 @@ void print_unsorted_suffixes(suffix_array* array) {
         return;
     }
 
-    // Obtain the starting position of each suffix string by offsetting
-    // the base pointer of the string with the suffix_offset.
-    for (suffix_offset = 0; suffix_offset < array->string_length; suffix_offset++) {
-        printf("%s\n", array->string + suffix_offset);
-    }
+    dump_suffixes(array, stdout, 0, DUMP_FULL, 0);
 }
 
 // Print the alphabetized suffixes in a suffix array.
 void print_sorted_suffixes(suffix_array* array) {
-    int suffix_index;
 
     if (array == NULL) {
         printf("Suffix array is NULL!\n");
 
         return;
     }
-   
-    // Obtain the starting position of each suffix string by offsetting
-    // the base pointer of the string with the appropriate offset found
-    // in array->suffixes.
-    for (suffix_index = 0; suffix_index < array->string_length; suffix_index++) {
-        printf("%s\n", array->string + array->suffixes[suffix_index]);
-    }
+
+    dump_suffixes(array, stdout, 1, DUMP_FULL, 0);
 }
 
 // Print a highlighted substring in the suffix array.
-void print_highlighted_substring(suffix_array* array, int start_pos, int length) {
-    int inset;
-    int counter;
+void print_highlighted_substring(suffix_array* array, text_position start_pos, text_position length) {
+    text_position inset;
+    text_position counter;
 
     if (array == NULL) {
         printf("Suffix array is NULL!\n");
@@ -364,14 +1121,37 @@ void print_highlighted_substring(suffix_array* array, int start_pos, int length)
     printf("\n");
 }
 
-// Destroy a suffix array.
+// Determine if a pointer refers to memory inside a suffix array's mapped index file.
+int is_mapped(suffix_array* array, void* pointer) {
+    return (
+        array != NULL
+        && array->mapping != NULL
+        && (char*) pointer >= (char*) array->mapping
+        && (char*) pointer < (char*) array->mapping + array->mapping_size
+    );
+}
+
+// Destroy a suffix array. Memory that belongs to a mapped index
+// file is unmapped rather than freed, and a borrowed string is left alone.
 void destroy_suffix_array(suffix_array* array) {
 
     if (array == NULL) {
         return;
     }
 
-    free(array->suffixes);
-    free(array->string);
+    destroy_lcp_array(array);
+    destroy_prefix_table(array);
+    destroy_search_layout(array);
+    destroy_query_cache(array);
+    if (array->mapping != NULL) {
+        munmap(array->mapping, array->mapping_size);
+    }
+    else {
+        free(array->suffixes);
+        free(array->packed_suffixes);
+        if (!array->borrows_string) {
+            free(array->string);
+        }
+    }
     free(array);
 }
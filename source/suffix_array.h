@@ -1,11 +1,58 @@
 // Header file for an integer queue.
 // Written by Tiger Sachse.
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <pthread.h>
 
 #define PADDING 10
-#define ALPHABET_SIZE 26
+#define INTEGER_QUEUE_CAPACITY 16
+#define ALPHABET_SIZE 256
+#define INDEX_MAGIC "SUFARRAY"
+#define INDEX_VERSION 3
+#define INDEX_OLDEST_VERSION 2
+#define INDEX_ALIGNMENT 8
+#define INDEX_HAS_LCP 0x1
+#define INDEX_PACKED_SUFFIXES 0x2
+#define INDEX_BIT_PACKED_SUFFIXES 0x4
+#define BATCH_READ_SIZE 65536
+#define BATCH_CHUNK_SIZE 256
+#define READ_BLOCK_SIZE 1048576
+#define DUMP_BUFFER_SIZE 1048576
+#define PACKED_SUFFIX_SIZE 5
+#define PACKED_BITS_MAX 56
+#define PREFIX_TABLE_MAX_ENTRIES 16777216
+#define SEARCH_LAYOUT_SPACING 16
+#define RANK_BLOCK_WORDS 8
+#define FM_SAMPLE_RATE 32
+#define FM_MAX_LEVELS 8
+#define APPEND_MAX_TIERS 64
+#define EXTERNAL_BLOCK_SIZE 65536
+#define STATS_CHARACTER_BUCKETS 65
+#define STATS_LATENCY_BUCKETS 512
+#define EXTERNAL_MIN_MEMORY 1048576
+#define EXTERNAL_DEFAULT_MEMORY 268435456
+#define QUERY_CACHE_WAYS 8
+#define QUERY_CACHE_KEY_SIZE 48
+#define QUERY_CACHE_LOCKS 64
+#define DOUBLING_PREFIX_BITS 31
+#define DOUBLING_RADIX_BITS 11
+#define DOUBLING_RADIX_MIN 1024
+#define DOUBLING_INSERTION_MAX 16
+#define DOUBLING_SHARED_MIN 65536
+
+// Positions and lengths within a string. Compile with LARGE_INDEX to index
+// strings longer than INT_MAX characters, at twice the memory per suffix.
+#ifdef LARGE_INDEX
+typedef long long text_position;
+#define TEXT_POSITION_MAX LLONG_MAX
+#define TEXT_POSITION_FORMAT "%lld"
+#else
+typedef int text_position;
+#define TEXT_POSITION_MAX INT_MAX
+#define TEXT_POSITION_FORMAT "%d"
+#endif
 
 // Signal flags for functions.
 typedef enum flag {
@@ -15,43 +62,415 @@ typedef enum flag {
     FLAG_PATTERN_LOWER
 } flag;
 
-// A node in the integer queue linked list.
-typedef struct integer_queue_node {
-    int data;
-    struct integer_queue_node* next;
-} integer_queue_node;
+// Algorithms available for sorting the suffixes of a suffix array.
+typedef enum sort_method {
+    SORT_INDUCED,
+    SORT_RADIX,
+    SORT_COUNTING,
+    SORT_PARALLEL
+} sort_method;
+
+// Ways of writing out the suffixes of a suffix array.
+typedef enum dump_mode {
+    DUMP_FULL,
+    DUMP_TRUNCATED,
+    DUMP_INDICES,
+    DUMP_NONE
+} dump_mode;
+
+// Ways of measuring how far a substring is from a pattern.
+typedef enum distance_measure {
+    DISTANCE_HAMMING,
+    DISTANCE_EDIT
+} distance_measure;
 
-// An integer queue that tracks the beginning and end of a linked list.
+// An integer queue stored in a ring buffer whose capacity is a power of two.
+// The front of the queue is at head, and the queue holds size integers.
 typedef struct integer_queue {
-    integer_queue_node* head;
-    integer_queue_node* tail;
+    text_position* data;
+    text_position capacity;
+    text_position head;
+    text_position size;
 } integer_queue;
 
-// A suffix array that holds a copy of the original string.
+// A range of sorted suffixes, from low up to but not including high.
+typedef struct suffix_range {
+    text_position low;
+    text_position high;
+} suffix_range;
+
+// A cached search result: the range of sorted suffixes that start with a
+// pattern of up to QUERY_CACHE_KEY_SIZE characters. The tag holds the high
+// bits of the pattern's hash to rule out most other patterns at a glance.
+// An entry that has never been used is empty.
+typedef struct cache_entry {
+    char pattern[QUERY_CACHE_KEY_SIZE];
+    unsigned int pattern_length;
+    unsigned int tag;
+    unsigned long long last_used;
+    suffix_range range;
+} cache_entry;
+
+// A bounded cache of search results. A pattern's hash picks one set of
+// QUERY_CACHE_WAYS entries, and the least recently used entry of the set
+// makes way for a new one. Each set is guarded by one of a fixed pool of
+// locks, and keeps its own clock for ordering its entries by use. Cached
+// ranges are never checked again, so a suffix array with a cache must not
+// change.
+typedef struct query_cache {
+    cache_entry* entries;
+    unsigned long long* set_clocks;
+    size_t set_count;
+    pthread_mutex_t locks[QUERY_CACHE_LOCKS];
+    unsigned long long hits;
+    unsigned long long misses;
+} query_cache;
+
+// A suffix array that holds a copy of the original string, unless it
+// borrows_string from someone else, like an appendable index. The LCP tables
+// are optional and are NULL until build_lcp_array is called. Once packed,
+// suffixes is NULL and every suffix lives in PACKED_SUFFIX_SIZE bytes of
+// packed_suffixes instead, or in suffix_bits bits if they were bit packed.
+// Each byte of the string maps to a symbol from 1 up to alphabet_size in
+// symbols, or to 0 if it never appears. The prefix table and search layout
+// are also optional, and are NULL until build_prefix_table and
+// build_search_layout are called, as is the query cache until
+// build_query_cache is.
 typedef struct suffix_array {
     char* string;
-    int* suffixes;
-    int string_length;
+    int borrows_string;
+    text_position* suffixes;
+    unsigned char* packed_suffixes;
+    int suffix_bits;
+    text_position* lcp;
+    text_position* left_lcp;
+    text_position* right_lcp;
+    text_position* prefix_table;
+    int prefix_length;
+    unsigned long long* layout_keys;
+    text_position* layout_samples;
+    text_position layout_count;
+    text_position layout_spacing;
+    int layout_symbol_bits;
+    text_position string_length;
+    unsigned char symbols[ALPHABET_SIZE];
+    int alphabet_size;
+    query_cache* cache;
+    void* mapping;
+    size_t mapping_size;
 } suffix_array;
 
+// The header at the start of an index file. Every offset is measured in bytes
+// from the start of the file. Multi-byte fields use the byte order of the
+// machine that wrote the file.
+typedef struct index_header {
+    char magic[8];
+    unsigned int version;
+    unsigned int flags;
+    unsigned int integer_size;
+    unsigned int alphabet_size;
+    unsigned long long string_length;
+    unsigned long long file_size;
+    unsigned long long alphabet_offset;
+    unsigned long long string_offset;
+    unsigned long long suffixes_offset;
+    unsigned long long lcp_offset;
+    unsigned long long left_lcp_offset;
+    unsigned long long right_lcp_offset;
+} index_header;
+
+// An approximate occurrence of a pattern, starting at a position of the
+// string, and the distance of the closest substring that starts there.
+typedef struct approximate_hit {
+    text_position position;
+    int distance;
+} approximate_hit;
+
+// A query in a batch, remembering where its pattern was in the input.
+typedef struct batch_query {
+    char* pattern;
+    int index;
+} batch_query;
+
+// A batch of patterns and their answers. The patterns and results are kept
+// in input order, while the queries are sorted by pattern before answering.
+typedef struct query_batch {
+    char* buffer;
+    char** patterns;
+    batch_query* order;
+    suffix_range* results;
+    int query_count;
+} query_batch;
+
+// A bit vector that answers rank queries in constant time. The number of
+// set bits before every block of RANK_BLOCK_WORDS words is kept alongside
+// the bits, so a rank only has to count the bits of a few words.
+typedef struct rank_bitvector {
+    unsigned long long* words;
+    text_position* block_ranks;
+    text_position length;
+} rank_bitvector;
+
+// An FM-index of a string, which answers the same searches as a suffix array
+// without keeping the string or its suffixes. The Burrows-Wheeler transform
+// of the string, with a 0 sentinel appended, is stored in a wavelet matrix
+// with one bit vector per bit of a symbol. Its rows are the sorted suffixes
+// of the string, shifted down by one for the sentinel's row. Only the rows
+// whose positions are multiples of sample_rate remember their positions,
+// which are divided by the rate and bit packed into sample_bits bits apiece.
+typedef struct fm_index {
+    rank_bitvector levels[FM_MAX_LEVELS];
+    text_position level_zeros[FM_MAX_LEVELS];
+    int level_count;
+    text_position counts[ALPHABET_SIZE + 1];
+    text_position symbol_starts[ALPHABET_SIZE + 1];
+    rank_bitvector sampled_rows;
+    unsigned char* samples;
+    int sample_bits;
+    text_position sample_rate;
+    text_position string_length;
+    unsigned char symbols[ALPHABET_SIZE];
+    int alphabet_size;
+} fm_index;
+
+// A generalized suffix array over a collection of documents, which are joined
+// into one string with the separator between each pair. Document d starts at
+// position starts[d] of the string, and starts[document_count] is one past
+// the end of the string.
+typedef struct document_collection {
+    suffix_array* array;
+    text_position* starts;
+    int document_count;
+    char separator;
+} document_collection;
+
+// An occurrence of a pattern in a collection of documents.
+typedef struct document_hit {
+    int document;
+    text_position offset;
+} document_hit;
+
+// A tier of an appendable index: a suffix array over the characters of the
+// index's string from start onwards, for as many as the array holds. The
+// array borrows those characters rather than keeping a copy.
+typedef struct index_tier {
+    suffix_array* array;
+    text_position start;
+} index_tier;
+
+// An index over a string that can grow at the end. The string is split into
+// tiers, oldest first, each with its own suffix array.
+typedef struct appendable_index {
+    char* string;
+    text_position string_length;
+    size_t capacity;
+    index_tier tiers[APPEND_MAX_TIERS];
+    int tier_count;
+    sort_method method;
+    int threads;
+} appendable_index;
+
+// The phases of building an index that are timed separately.
+typedef enum build_phase {
+    PHASE_READ,
+    PHASE_SORT,
+    PHASE_LCP,
+    PHASE_PREFIX_TABLE,
+    PHASE_LAYOUT,
+    PHASE_PACK,
+    PHASE_FM_INDEX,
+    BUILD_PHASES
+} build_phase;
+
+// Statistics gathered while building indexes.
+typedef struct build_stats {
+    unsigned long long phase_nanoseconds[BUILD_PHASES];
+    unsigned long long sort_passes;
+    unsigned long long queue_allocations;
+    unsigned long long bucket_allocations;
+} build_stats;
+
+// The counters of the search in progress on one thread.
+typedef struct search_counters {
+    unsigned long long probes;
+    unsigned long long characters;
+} search_counters;
+
+// Statistics gathered across every search. Bucket b of the character
+// histogram counts searches that compared from 2 to the b - 1 up to 2 to the
+// b characters, with bucket 0 for none. Latencies are bucketed by powers of
+// two, each split into 8 equal buckets.
+typedef struct search_stats {
+    unsigned long long searches;
+    unsigned long long probes;
+    unsigned long long characters;
+    unsigned long long longest_latency;
+    unsigned long long character_histogram[STATS_CHARACTER_BUCKETS];
+    unsigned long long latency_histogram[STATS_LATENCY_BUCKETS];
+} search_stats;
+
+// Counters and timers for the hot paths. Compile with NO_STATS to remove
+// them entirely. Otherwise they cost a single check of stats_enabled until
+// enable_stats is called.
+#ifdef NO_STATS
+#define STATS_TIME() 0ULL
+#define STATS_BUILD_ADD(counter, amount) ((void) 0)
+#define STATS_SEARCH_ADD(counter, amount) ((void) 0)
+#define STATS_PHASE(phase, start) ((void) (start))
+#define STATS_SEARCH(start) ((void) (start))
+#else
+extern int stats_enabled;
+extern build_stats collected_build_stats;
+extern search_stats collected_search_stats;
+extern _Thread_local search_counters current_search;
+#define STATS_TIME() (stats_enabled ? stats_clock() : 0ULL)
+#define STATS_BUILD_ADD(counter, amount) do { \
+    if (stats_enabled) { \
+        __atomic_fetch_add(&collected_build_stats.counter, (amount), __ATOMIC_RELAXED); \
+    } \
+} while (0)
+#define STATS_SEARCH_ADD(counter, amount) do { \
+    if (stats_enabled) { \
+        current_search.counter += (amount); \
+    } \
+} while (0)
+#define STATS_PHASE(phase, start) do { \
+    if (stats_enabled) { \
+        record_phase((phase), (start)); \
+    } \
+} while (0)
+#define STATS_SEARCH(start) do { \
+    if (stats_enabled) { \
+        record_search(start); \
+    } \
+} while (0)
+#endif
+
 // Functional prototypes for integer queues.
 integer_queue* new_integer_queue(void);
-integer_queue_node* new_integer_queue_node(int);
 int is_empty(integer_queue*);
-flag enqueue(integer_queue*, int);
-int dequeue(integer_queue*);
+flag enqueue(integer_queue*, text_position);
+text_position dequeue(integer_queue*);
 void print_integer_queue(integer_queue*);
 void destroy_integer_queue(integer_queue*);
 void destroy_integer_queues(integer_queue**, int);
 
 // Functional prototypes for suffix arrays.
-int index_of_character(char);
+int index_of_character(suffix_array*, char);
+void build_alphabet(suffix_array*);
 int is_alphabetic(char);
+size_t filter_characters(const char*, size_t, char*, int);
 flag contains(char*, char*);
 suffix_array* new_suffix_array(char*);
+suffix_array* new_suffix_array_using(char*, sort_method, int);
+suffix_array* new_borrowed_suffix_array(char*, text_position, sort_method, int);
 flag sort_suffixes_alphabetically(suffix_array*);
-int search(suffix_array*, char*);
+flag sort_suffixes_by_induction(suffix_array*);
+flag sort_suffixes_by_counting(suffix_array*);
+text_position suffix_at(suffix_array*, text_position);
+int bits_needed(text_position);
+size_t bit_packed_size(text_position, int);
+text_position bit_packed_value(unsigned char*, text_position, int);
+flag pack_suffixes(suffix_array*);
+flag bit_pack_suffixes(suffix_array*);
+text_position search(suffix_array*, char*);
+flag search_range(suffix_array*, char*, suffix_range*);
+flag narrow_range(suffix_array*, char*, text_position, suffix_range*);
+text_position count_occurrences(suffix_array*, char*);
+text_position next_occurrence(suffix_array*, suffix_range*);
+flag dump_suffixes(suffix_array*, FILE*, int, dump_mode, text_position);
 void print_unsorted_suffixes(suffix_array*);
 void print_sorted_suffixes(suffix_array*);
-void print_highlighted_substring(suffix_array*, int, int);
+void print_highlighted_substring(suffix_array*, text_position, text_position);
+int is_mapped(suffix_array*, void*);
 void destroy_suffix_array(suffix_array*);
+
+// Functional prototypes for LCP arrays.
+flag build_lcp_array(suffix_array*);
+void destroy_lcp_array(suffix_array*);
+
+// Functional prototypes for string comparison.
+text_position common_prefix_length(const char*, const char*, text_position);
+flag compare_prefix(const char*, text_position, const char*, text_position, text_position, text_position*);
+
+// Functional prototypes for prefix tables.
+flag build_prefix_table(suffix_array*, int);
+void prefix_range(suffix_array*, char*, text_position, suffix_range*);
+void destroy_prefix_table(suffix_array*);
+
+// Functional prototypes for search layouts.
+flag build_search_layout(suffix_array*, text_position);
+void narrow_search(suffix_array*, char*, text_position, suffix_range*);
+void destroy_search_layout(suffix_array*);
+
+// Functional prototypes for query caches.
+flag build_query_cache(suffix_array*, size_t);
+int find_cached_range(query_cache*, const char*, text_position, suffix_range*);
+void cache_range(query_cache*, const char*, text_position, suffix_range*);
+void destroy_query_cache(suffix_array*);
+
+// Functional prototypes for index files.
+flag save_suffix_array(suffix_array*, char*);
+suffix_array* load_suffix_array(char*);
+void lay_out_index(index_header*, text_position, int, unsigned int, size_t);
+flag pad_index_section(FILE*, size_t);
+
+// Functional prototypes for external construction.
+flag build_external_index(char*, char*, int, size_t, char*);
+
+// Functional prototypes for batch queries.
+query_batch* read_query_batch(FILE*);
+flag run_query_batch(suffix_array*, query_batch*, int);
+flag run_fm_query_batch(fm_index*, query_batch*, int);
+void print_query_batch(suffix_array*, query_batch*);
+void print_fm_query_batch(fm_index*, query_batch*);
+int default_thread_count(void);
+void destroy_query_batch(query_batch*);
+
+// Functional prototypes for parallel sorting.
+flag sort_suffixes_in_parallel(suffix_array*, int);
+
+// Functional prototypes for FM-indexes.
+fm_index* new_fm_index(suffix_array*, text_position);
+flag fm_search_range(fm_index*, char*, suffix_range*);
+text_position fm_count_occurrences(fm_index*, char*);
+text_position fm_locate(fm_index*, text_position);
+text_position fm_next_occurrence(fm_index*, suffix_range*);
+size_t fm_index_size(fm_index*);
+void destroy_fm_index(fm_index*);
+
+// Functional prototypes for document collections.
+document_collection* new_document_collection(char**, int, sort_method, int);
+int document_of(document_collection*, text_position);
+flag document_search_range(document_collection*, char*, suffix_range*);
+flag next_document_hit(document_collection*, suffix_range*, document_hit*);
+int list_documents(document_collection*, suffix_range*, int*);
+void destroy_document_collection(document_collection*);
+
+// Functional prototypes for appendable indexes.
+appendable_index* new_appendable_index(sort_method, int);
+flag append_text(appendable_index*, char*);
+flag compact_appendable_index(appendable_index*);
+text_position appendable_count_occurrences(appendable_index*, char*);
+text_position appendable_find_occurrences(appendable_index*, char*, text_position**);
+void destroy_appendable_index(appendable_index*);
+
+// Functional prototypes for approximate searches.
+text_position approximate_search(suffix_array*, char*, int, distance_measure, approximate_hit**);
+
+// Functional prototypes for repeat analysis.
+flag longest_repeat(suffix_array*, text_position*, text_position*, text_position*);
+text_position print_maximal_repeats(suffix_array*, text_position, FILE*);
+flag longest_common_substring(document_collection*, text_position*, text_position*, text_position*);
+text_position print_maximal_unique_matches(document_collection*, text_position, FILE*);
+
+// Functional prototypes for statistics.
+void enable_stats(void);
+unsigned long long stats_clock(void);
+void record_phase(build_phase, unsigned long long);
+void record_search(unsigned long long);
+void print_stats(FILE*);
+void print_stats_json(FILE*);
+
+// Functional prototypes for induced sorting.
+flag induced_sort(text_position*, text_position*, text_position, text_position);
@@ -2,10 +2,12 @@
 # Written by Tiger Sachse.
 
 PROGRAM_NAME="sufarray"
+BENCHMARK_NAME="sufarray_benchmark"
+CHECK_NAME="sufarray_check"
 
 # Build the program.
 build_program() {
-    gcc source/*.c -o $PROGRAM_NAME
+    gcc $CFLAGS source/*.c -pthread -o $PROGRAM_NAME
 }
 
 # Run the program and clean up afterwards.
@@ -22,6 +24,37 @@ test_program() {
     rm -rf $PROGRAM_NAME
 }
 
+# Report how long a parallel build of the given file takes with 1, 2, 4, and
+# one thread per processor.
+scale_program() {
+    build_program
+    for THREADS in 1 2 4 $(nproc); do
+        echo -n "$THREADS thread(s): "
+        ./$PROGRAM_NAME --parallel --threads $THREADS --time --batch /dev/null "$@" 2>&1
+    done
+    rm -rf $PROGRAM_NAME
+}
+
+# Build and run the benchmark suite with optimizations enabled.
+benchmark_program() {
+    gcc -O2 $CFLAGS benchmark/*.c $(ls source/*.c | grep -v driver.c) -pthread -o $BENCHMARK_NAME
+    ./$BENCHMARK_NAME "$@"
+    rm -rf $BENCHMARK_NAME
+}
+
+# Cross-check every sorting method on the examples, plus any given files, in
+# both the normal and the large index build. Fails if any of them disagree.
+check_program() {
+    STATUS=0
+    for FLAGS in "" "-DLARGE_INDEX"; do
+        gcc -O2 $CFLAGS $FLAGS test/*.c $(ls source/*.c | grep -v driver.c) -pthread -o $CHECK_NAME
+        ./$CHECK_NAME examples/*.txt "$@" || STATUS=1
+    done
+    rm -rf $CHECK_NAME
+
+    return $STATUS
+}
+
 # Entry point of the script.
 case $1 in
     "--build")
@@ -35,4 +68,16 @@ case $1 in
     "--test")
         test_program "${@:2}"
         ;;
+
+    "--scale")
+        scale_program "${@:2}"
+        ;;
+
+    "--benchmark")
+        benchmark_program "${@:2}"
+        ;;
+
+    "--check")
+        check_program "${@:2}"
+        ;;
 esac
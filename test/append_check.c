@@ -0,0 +1,143 @@
+// Cross-checks appendable indexes against brute force. Every input is appended
+// a piece at a time, so tiers are made and merged along the way, and searches
+// halfway through, at the end, and after compacting must all match a scan of
+// the text appended so far.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cross_check.h"
+
+// Check an appendable index's text and its searches for random patterns
+// against brute force over the text appended so far. The last pattern is the
+// end of that text, which can cross into the newest tier.
+static void check_appended(
+    char* name,
+    char* stage,
+    appendable_index* index,
+    char* string,
+    text_position length,
+    text_position* positions
+) {
+    int pattern_index;
+    text_position count;
+    text_position* found;
+    char pattern[PATTERN_MAX_LENGTH + 1];
+    unsigned long long state;
+
+    check_count++;
+    if (index->string_length != length || memcmp(index->string, string, length) != 0) {
+        printf("FAILED: appendable index holds the wrong text %s on %s.\n", stage, name);
+        failure_count++;
+
+        return;
+    }
+
+    state = input_count;
+    for (pattern_index = 0; pattern_index <= PATTERN_COUNT; pattern_index++) {
+        if (pattern_index < PATTERN_COUNT) {
+            random_pattern(string, length, &state, pattern);
+        }
+        else {
+            count = (length < PATTERN_MAX_LENGTH) ? length : PATTERN_MAX_LENGTH;
+            memcpy(pattern, string + length - count, count);
+            pattern[count] = '\0';
+        }
+        count = brute_occurrences(string, length, pattern, NULL, positions);
+        if (
+            appendable_count_occurrences(index, pattern) != count
+            || appendable_find_occurrences(index, pattern, &found) != count
+            || (count > 0 && memcmp(found, positions, sizeof(text_position) * count) != 0)
+        ) {
+            printf("FAILED: appendable index is wrong for pattern %d %s on %s.\n", pattern_index, stage, name);
+            failure_count++;
+            free(found);
+
+            return;
+        }
+        free(found);
+    }
+}
+
+// Check an appendable index of a string. The pieces appended are at most a
+// few characters long for some inputs and over a hundred for others, so
+// merges happen at every scale.
+void check_appendable_indexes(char* name, char* string) {
+    int halfway;
+    text_position length;
+    text_position appended;
+    text_position piece_length;
+    text_position piece_limit;
+    text_position* positions;
+    char* piece;
+    unsigned long long state;
+    appendable_index* index;
+
+    length = strlen(string);
+    positions = malloc(sizeof(text_position) * length);
+    piece = malloc(sizeof(char) * (length + 1));
+    index = new_appendable_index(SORT_INDUCED, 1);
+    if (positions == NULL || piece == NULL || index == NULL) {
+        printf("FAILED: out of memory.\n");
+        failure_count++;
+        free(positions);
+        free(piece);
+        destroy_appendable_index(index);
+
+        return;
+    }
+
+    // Appending nothing must leave the index as it was.
+    check_count++;
+    if (append_text(index, "") == FLAG_FAILURE || index->string_length != 0 || index->tier_count != 0) {
+        printf("FAILED: appending nothing changed an appendable index of %s.\n", name);
+        failure_count++;
+    }
+
+    state = input_count;
+    piece_limit = (text_position) 1 << (input_count % 8);
+    halfway = 0;
+    check_count++;
+    for (appended = 0; appended < length; appended += piece_length) {
+        piece_length = 1 + next_random(&state) % piece_limit;
+        if (piece_length > length - appended) {
+            piece_length = length - appended;
+        }
+        memcpy(piece, string + appended, piece_length);
+        piece[piece_length] = '\0';
+        if (append_text(index, piece) == FLAG_FAILURE) {
+            printf(
+                "FAILED: couldn't append " TEXT_POSITION_FORMAT " characters at position "
+                TEXT_POSITION_FORMAT " of %s.\n",
+                piece_length,
+                appended,
+                name
+            );
+            failure_count++;
+            free(positions);
+            free(piece);
+            destroy_appendable_index(index);
+
+            return;
+        }
+        if (!halfway && 2 * (appended + piece_length) >= length) {
+            check_appended(name, "halfway through", index, string, appended + piece_length, positions);
+            halfway = 1;
+        }
+    }
+    check_appended(name, "after appending", index, string, length, positions);
+
+    check_count++;
+    if (compact_appendable_index(index) == FLAG_FAILURE || index->tier_count != 1) {
+        printf("FAILED: couldn't compact an appendable index of %s.\n", name);
+        failure_count++;
+    }
+    else {
+        check_appended(name, "after compacting", index, string, length, positions);
+    }
+
+    free(positions);
+    free(piece);
+    destroy_appendable_index(index);
+}
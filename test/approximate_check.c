@@ -0,0 +1,115 @@
+// Cross-checks approximate searches against brute force. Every input is
+// searched for random patterns within a few mismatches or edits, and every
+// hit must match a scan of the whole string, distance and all.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cross_check.h"
+
+#define MAX_DISTANCE 2
+
+static const char* measure_names[] = {"Hamming", "edit"};
+
+// Check that two lists of hits are the same. Hits are compared field by
+// field, since they may hold padding.
+static int same_hits(approximate_hit* first, approximate_hit* second, text_position count) {
+    text_position hit;
+
+    for (hit = 0; hit < count; hit++) {
+        if (first[hit].position != second[hit].position || first[hit].distance != second[hit].distance) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Check an approximate search of a suffix array against brute force. Hits
+// must be refused for patterns no longer than the distance. Both hit lists
+// are in string order, so they must be identical.
+static void check_approximate_search(
+    char* name,
+    suffix_array* array,
+    char* pattern,
+    int pattern_index,
+    int max_distance,
+    distance_measure measure,
+    approximate_hit* expected
+) {
+    text_position count;
+    text_position found_count;
+    approximate_hit* found;
+
+    check_count++;
+    found_count = approximate_search(array, pattern, max_distance, measure, &found);
+    if (strlen(pattern) <= (size_t) max_distance) {
+        count = FLAG_FAILURE;
+    }
+    else {
+        count = brute_approximate(array->string, array->string_length, pattern, max_distance, measure, expected);
+    }
+    if (
+        found_count != count
+        || (count > 0 && !same_hits(found, expected, count))
+    ) {
+        printf(
+            "FAILED: %s search within %d of pattern %d is wrong on %s%s.\n",
+            measure_names[measure],
+            max_distance,
+            pattern_index,
+            name,
+            (array->lcp != NULL) ? " (with LCP tables)" : ""
+        );
+        failure_count++;
+    }
+    free(found);
+}
+
+// Check approximate searches of a string for random patterns, by both
+// measures, on a plain suffix array and on a bit packed one with LCP tables.
+void check_approximate_searches(char* name, char* string) {
+    int pattern_index;
+    int max_distance;
+    text_position length;
+    char pattern[PATTERN_MAX_LENGTH + 1];
+    unsigned long long state;
+    approximate_hit* expected;
+    suffix_array* plain;
+    suffix_array* tabled;
+
+    length = strlen(string);
+    expected = malloc(sizeof(approximate_hit) * length);
+    plain = new_suffix_array_using(string, SORT_INDUCED, 1);
+    tabled = new_suffix_array_using(string, SORT_INDUCED, 1);
+    if (
+        expected == NULL
+        || plain == NULL
+        || tabled == NULL
+        || build_lcp_array(tabled) == FLAG_FAILURE
+        || bit_pack_suffixes(tabled) == FLAG_FAILURE
+    ) {
+        printf("FAILED: couldn't build suffix arrays for approximate searches of %s.\n", name);
+        failure_count++;
+        free(expected);
+        destroy_suffix_array(plain);
+        destroy_suffix_array(tabled);
+
+        return;
+    }
+
+    state = input_count;
+    for (pattern_index = 0; pattern_index < PATTERN_COUNT; pattern_index++) {
+        random_pattern(string, length, &state, pattern);
+        max_distance = pattern_index % (MAX_DISTANCE + 1);
+        check_approximate_search(name, plain, pattern, pattern_index, max_distance, DISTANCE_HAMMING, expected);
+        check_approximate_search(name, plain, pattern, pattern_index, max_distance, DISTANCE_EDIT, expected);
+        check_approximate_search(name, tabled, pattern, pattern_index, max_distance, DISTANCE_HAMMING, expected);
+        check_approximate_search(name, tabled, pattern, pattern_index, max_distance, DISTANCE_EDIT, expected);
+    }
+
+    free(expected);
+    destroy_suffix_array(plain);
+    destroy_suffix_array(tabled);
+}
@@ -0,0 +1,502 @@
+// Provides brute-force answers for the cross-checks. Each one scans the whole
+// string, so it is slow but too simple to get wrong.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cross_check.h"
+
+// Compare the suffix of a string at a position with a pattern, in sorted
+// suffix order. Returns 0 if the suffix starts with the pattern, and
+// otherwise a negative number if the suffix sorts below the pattern or a
+// positive one if it sorts above it.
+int compare_suffix(char* string, text_position length, text_position position, char* pattern, text_position pattern_length) {
+    int comparison;
+    text_position shorter;
+
+    shorter = (length - position < pattern_length) ? length - position : pattern_length;
+    if ((comparison = memcmp(string + position, pattern, shorter)) != 0) {
+        return comparison;
+    }
+
+    // A suffix that runs out before the pattern does sorts below it.
+    return (shorter < pattern_length) ? -1 : 0;
+}
+
+// Find every position where a pattern appears in a string, in string order,
+// saving them in positions if it isn't NULL. The number of suffixes that sort
+// below the pattern is saved in below if it isn't NULL. Returns the number of
+// positions.
+text_position brute_occurrences(char* string, text_position length, char* pattern, text_position* below, text_position* positions) {
+    int comparison;
+    text_position count;
+    text_position position;
+    text_position pattern_length;
+
+    pattern_length = strlen(pattern);
+    count = 0;
+    if (below != NULL) {
+        *below = 0;
+    }
+    for (position = 0; position < length; position++) {
+        comparison = compare_suffix(string, length, position, pattern, pattern_length);
+        if (comparison == 0) {
+            if (positions != NULL) {
+                positions[count] = position;
+            }
+            count++;
+        }
+        else if (comparison < 0 && below != NULL) {
+            (*below)++;
+        }
+    }
+
+    return count;
+}
+
+// Count the characters that the suffixes of a string at two positions share
+// before they differ.
+text_position brute_common_prefix(char* string, text_position length, text_position first, text_position second) {
+    text_position matched;
+
+    matched = 0;
+    while (
+        first + matched < length
+        && second + matched < length
+        && string[first + matched] == string[second + matched]
+    ) {
+        matched++;
+    }
+
+    return matched;
+}
+
+// Compare two positions.
+static int compare_positions(const void* first, const void* second) {
+    text_position left;
+    text_position right;
+
+    left = *(const text_position*) first;
+    right = *(const text_position*) second;
+
+    return (left > right) - (left < right);
+}
+
+// Sort positions into string order.
+void sort_positions(text_position* positions, text_position count) {
+
+    if (count > 1) {
+        qsort(positions, count, sizeof(text_position), compare_positions);
+    }
+}
+
+// Find the smallest edit distance between a pattern and any substring of a
+// string that starts at a position. Only substrings of up to max_distance
+// characters more than the pattern can be close enough to matter, and rows
+// holds room for one row of the distance table per extra character.
+static int brute_edit_distance(
+    char* string,
+    text_position length,
+    text_position position,
+    char* pattern,
+    text_position pattern_length,
+    int max_distance,
+    text_position* rows
+) {
+    text_position depth;
+    text_position column;
+    text_position smallest;
+    text_position* row;
+    text_position* next;
+
+    for (column = 0; column <= pattern_length; column++) {
+        rows[column] = column;
+    }
+    smallest = pattern_length;
+    for (depth = 0; depth < pattern_length + max_distance && position + depth < length; depth++) {
+        row = rows + depth * (pattern_length + 1);
+        next = row + pattern_length + 1;
+        next[0] = depth + 1;
+        for (column = 1; column <= pattern_length; column++) {
+            next[column] = row[column - 1] + (string[position + depth] != pattern[column - 1]);
+            if (row[column] + 1 < next[column]) {
+                next[column] = row[column] + 1;
+            }
+            if (next[column - 1] + 1 < next[column]) {
+                next[column] = next[column - 1] + 1;
+            }
+        }
+        if (next[pattern_length] < smallest) {
+            smallest = next[pattern_length];
+        }
+    }
+
+    return smallest;
+}
+
+// Find every position where a substring within a distance of a pattern
+// starts, in string order, saving them in hits, which must have room for
+// every position of the string. Returns the number of hits.
+text_position brute_approximate(
+    char* string,
+    text_position length,
+    char* pattern,
+    int max_distance,
+    distance_measure measure,
+    approximate_hit* hits
+) {
+    int distance;
+    text_position count;
+    text_position position;
+    text_position character;
+    text_position pattern_length;
+    text_position* rows;
+
+    pattern_length = strlen(pattern);
+    rows = malloc(sizeof(text_position) * (pattern_length + max_distance + 1) * (pattern_length + 1));
+    if (rows == NULL) {
+        return FLAG_FAILURE;
+    }
+
+    count = 0;
+    for (position = 0; position < length; position++) {
+        if (measure == DISTANCE_HAMMING) {
+            if (position + pattern_length > length) {
+                break;
+            }
+            distance = 0;
+            for (character = 0; character < pattern_length; character++) {
+                distance += (string[position + character] != pattern[character]);
+            }
+        }
+        else {
+            distance = brute_edit_distance(string, length, position, pattern, pattern_length, max_distance, rows);
+        }
+        if (distance <= max_distance) {
+            hits[count].position = position;
+            hits[count].distance = distance;
+            count++;
+        }
+    }
+    free(rows);
+
+    return count;
+}
+
+// Fill row with the common prefix lengths of the suffix of first at a
+// position and every suffix of second, given the same row for the next
+// position of first. Both rows have an extra 0 at the end, for the empty
+// suffix of second.
+static void next_prefix_row(
+    char* first,
+    text_position position,
+    char* second,
+    text_position second_length,
+    text_position* next,
+    text_position* row
+) {
+    text_position index;
+
+    for (index = 0; index < second_length; index++) {
+        row[index] = (first[position] == second[index]) ? next[index + 1] + 1 : 0;
+    }
+    row[second_length] = 0;
+}
+
+// Find the longest substring that appears more than once in a string.
+// Returns its length.
+text_position brute_longest_repeat(char* string, text_position length) {
+    text_position index;
+    text_position position;
+    text_position longest;
+    text_position* row;
+    text_position* next;
+    text_position* swap;
+
+    row = calloc(length + 1, sizeof(text_position));
+    next = calloc(length + 1, sizeof(text_position));
+    if (row == NULL || next == NULL) {
+        free(row);
+        free(next);
+
+        return FLAG_FAILURE;
+    }
+
+    longest = 0;
+    for (position = length - 1; position >= 0; position--) {
+        next_prefix_row(string, position, string, length, next, row);
+        for (index = position + 1; index < length; index++) {
+            if (row[index] > longest) {
+                longest = row[index];
+            }
+        }
+        swap = row;
+        row = next;
+        next = swap;
+    }
+    free(row);
+    free(next);
+
+    return longest;
+}
+
+// Compare two occurrences by the common prefix length they were found at,
+// longest first.
+static int compare_occurrences(const void* first, const void* second) {
+    const brute_match* left;
+    const brute_match* right;
+
+    left = (const brute_match*) first;
+    right = (const brute_match*) second;
+
+    return (left->length < right->length) - (left->length > right->length);
+}
+
+// Save a result in a growing list of results.
+static flag save_result(brute_match** results, text_position* count, text_position* capacity, brute_match* result) {
+    brute_match* resized;
+
+    if (*count == *capacity) {
+        *capacity = 2 * *capacity + 16;
+        if ((resized = realloc(*results, sizeof(brute_match) * *capacity)) == NULL) {
+            return FLAG_FAILURE;
+        }
+        *results = resized;
+    }
+    (*results)[(*count)++] = *result;
+
+    return FLAG_SUCCESS;
+}
+
+// Find every maximal repeat of at least a minimum length in a string. Each is
+// saved in a new list, which the caller must free, as its first position, the
+// number of times it appears, and its length. A substring starting at a
+// position is new if no earlier suffix shares that much of the position's
+// suffix. The suffixes that share the most with it are its occurrences at
+// each length, and they are added longest first, so the characters before
+// and after them can be tracked as the length shrinks. Returns the number of
+// repeats.
+text_position brute_maximal_repeats(char* string, text_position length, text_position min_length, brute_match** repeats) {
+    int left;
+    int before;
+    text_position index;
+    text_position count;
+    text_position capacity;
+    text_position position;
+    text_position earlier;
+    text_position candidates;
+    text_position added;
+    text_position occurrences;
+    text_position repeat_length;
+    text_position* row;
+    text_position* next;
+    text_position* swap;
+    brute_match repeat;
+    brute_match* sharing;
+
+    *repeats = NULL;
+    row = calloc(length + 1, sizeof(text_position));
+    next = calloc(length + 1, sizeof(text_position));
+    sharing = malloc(sizeof(brute_match) * length);
+    if (row == NULL || next == NULL || sharing == NULL) {
+        free(row);
+        free(next);
+        free(sharing);
+
+        return FLAG_FAILURE;
+    }
+
+    count = 0;
+    capacity = 0;
+    for (position = length - 1; position >= 0; position--) {
+        next_prefix_row(string, position, string, length, next, row);
+        earlier = 0;
+        for (index = 0; index < position; index++) {
+            if (row[index] > earlier) {
+                earlier = row[index];
+            }
+        }
+        candidates = 0;
+        for (index = position; index < length; index++) {
+            if (row[index] > earlier) {
+                sharing[candidates].first = index;
+                sharing[candidates].length = row[index];
+                candidates++;
+            }
+        }
+        qsort(sharing, candidates, sizeof(brute_match), compare_occurrences);
+
+        // A repeat can't be grown to the right if one of its occurrences
+        // stops sharing at its length, and can't be grown to the left if two
+        // of them follow different characters, or one starts the string.
+        added = 0;
+        occurrences = 0;
+        left = -1;
+        for (repeat_length = length - position; repeat_length > earlier; repeat_length--) {
+            while (added < candidates && sharing[added].length >= repeat_length) {
+                index = sharing[added].first;
+                before = (index == 0) ? -2 : (unsigned char) string[index - 1];
+                left = (left == -1 || left == before) ? before : -2;
+                occurrences++;
+                added++;
+            }
+            if (
+                occurrences >= 2
+                && left == -2
+                && repeat_length >= min_length
+                && (repeat_length == length - position || sharing[added - 1].length == repeat_length)
+            ) {
+                repeat.first = position;
+                repeat.second = occurrences;
+                repeat.length = repeat_length;
+                if (save_result(repeats, &count, &capacity, &repeat) == FLAG_FAILURE) {
+                    count = FLAG_FAILURE;
+                    break;
+                }
+            }
+        }
+        if (count == FLAG_FAILURE) {
+            break;
+        }
+        swap = row;
+        row = next;
+        next = swap;
+    }
+    free(row);
+    free(next);
+    free(sharing);
+
+    return count;
+}
+
+// Find the longest substring shared by two strings. Returns its length.
+text_position brute_longest_common_substring(char* first, text_position first_length, char* second, text_position second_length) {
+    text_position index;
+    text_position position;
+    text_position longest;
+    text_position* row;
+    text_position* next;
+    text_position* swap;
+
+    row = calloc(second_length + 1, sizeof(text_position));
+    next = calloc(second_length + 1, sizeof(text_position));
+    if (row == NULL || next == NULL) {
+        free(row);
+        free(next);
+
+        return FLAG_FAILURE;
+    }
+
+    longest = 0;
+    for (position = first_length - 1; position >= 0; position--) {
+        next_prefix_row(first, position, second, second_length, next, row);
+        for (index = 0; index < second_length; index++) {
+            if (row[index] > longest) {
+                longest = row[index];
+            }
+        }
+        swap = row;
+        row = next;
+        next = swap;
+    }
+    free(row);
+    free(next);
+
+    return longest;
+}
+
+// Count how many entries of a row are at least each length, for lengths up
+// to limit.
+static void count_at_least(text_position* row, text_position row_length, text_position* counts, text_position limit) {
+    text_position index;
+
+    memset(counts, 0, sizeof(text_position) * (limit + 2));
+    for (index = 0; index < row_length; index++) {
+        counts[row[index]]++;
+    }
+    for (index = limit; index >= 0; index--) {
+        counts[index] += counts[index + 1];
+    }
+}
+
+// Find every maximal unique match of at least a minimum length between two
+// strings. Each is saved in a new list, which the caller must free, as its
+// positions in both strings and its length. Every common prefix of a suffix
+// of each string can't be grown to the right, and it is unique if no other
+// suffix of either string shares that much with the first one's. Returns the
+// number of matches.
+text_position brute_maximal_unique_matches(
+    char* first,
+    text_position first_length,
+    char* second,
+    text_position second_length,
+    text_position min_length,
+    brute_match** matches
+) {
+    text_position index;
+    text_position count;
+    text_position limit;
+    text_position capacity;
+    text_position position;
+    text_position* rows[4];
+    text_position* swap;
+    text_position* first_counts;
+    text_position* second_counts;
+    brute_match match;
+
+    *matches = NULL;
+    limit = first_length + second_length;
+    rows[0] = calloc(second_length + 1, sizeof(text_position));
+    rows[1] = calloc(second_length + 1, sizeof(text_position));
+    rows[2] = calloc(first_length + 1, sizeof(text_position));
+    rows[3] = calloc(first_length + 1, sizeof(text_position));
+    first_counts = malloc(sizeof(text_position) * (limit + 2));
+    second_counts = malloc(sizeof(text_position) * (limit + 2));
+    count = 0;
+    if (
+        rows[0] == NULL || rows[1] == NULL || rows[2] == NULL || rows[3] == NULL
+        || first_counts == NULL || second_counts == NULL
+    ) {
+        count = FLAG_FAILURE;
+    }
+
+    // Rows 0 and 1 compare the first string with the second, and rows 2 and
+    // 3 compare it with itself.
+    capacity = 0;
+    for (position = first_length - 1; count != FLAG_FAILURE && position >= 0; position--) {
+        next_prefix_row(first, position, second, second_length, rows[1], rows[0]);
+        next_prefix_row(first, position, first, first_length, rows[3], rows[2]);
+        count_at_least(rows[0], second_length, second_counts, limit);
+        count_at_least(rows[2], first_length, first_counts, limit);
+        for (index = 0; index < second_length; index++) {
+            match.length = rows[0][index];
+            if (
+                match.length >= min_length
+                && second_counts[match.length] == 1
+                && first_counts[match.length] == 1
+                && (position == 0 || index == 0 || first[position - 1] != second[index - 1])
+            ) {
+                match.first = position;
+                match.second = index;
+                if (save_result(matches, &count, &capacity, &match) == FLAG_FAILURE) {
+                    count = FLAG_FAILURE;
+                    break;
+                }
+            }
+        }
+        swap = rows[0];
+        rows[0] = rows[1];
+        rows[1] = swap;
+        swap = rows[2];
+        rows[2] = rows[3];
+        rows[3] = swap;
+    }
+    for (index = 0; index < 4; index++) {
+        free(rows[index]);
+    }
+    free(first_counts);
+    free(second_counts);
+
+    return count;
+}
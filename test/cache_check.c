@@ -0,0 +1,193 @@
+// Cross-checks query caches against brute force. Every input is searched for
+// the same patterns over and over through caches of several sizes, alone, on
+// top of a prefix table, and from several batch threads at once. Cached
+// answers must match a scan of the whole string just like fresh ones.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cross_check.h"
+
+#define CACHE_ROUNDS 3
+#define CACHE_THREADS 4
+#define LONG_PATTERN_LENGTH (QUERY_CACHE_KEY_SIZE + 8)
+
+// A pattern and its brute-force answer: how many times it appears, and how
+// many suffixes sort below it.
+typedef struct cache_query {
+    char pattern[LONG_PATTERN_LENGTH + 1];
+    text_position count;
+    text_position below;
+} cache_query;
+
+// Check a range found for a query against its brute-force answer.
+static int matches_query(suffix_range* range, cache_query* query) {
+    return range->high - range->low == query->count && (query->count == 0 || range->low == query->below);
+}
+
+// Search a suffix array with a cache for every query, several times over,
+// checking each answer. Every search of a suffix array without a prefix
+// table asks the cache, so its hits and misses must add up to the number of
+// searches. A cache big enough for every query only misses the first time
+// it's asked for each one, or whenever a pattern is too long to cache.
+static void check_cached_searches(char* name, char* kind, suffix_array* array, cache_query* queries, int query_count) {
+    int round;
+    int query;
+    int long_queries;
+    int large;
+    suffix_range range;
+
+    check_count++;
+    long_queries = 0;
+    large = (array->cache->set_count * QUERY_CACHE_WAYS >= (size_t) query_count);
+    for (round = 0; round < CACHE_ROUNDS; round++) {
+        for (query = 0; query < query_count; query++) {
+            if (
+                search_range(array, queries[query].pattern, &range) == FLAG_FAILURE
+                || !matches_query(&range, &queries[query])
+            ) {
+                printf("FAILED: %s search for query %d in round %d is wrong on %s.\n", kind, query, round, name);
+                failure_count++;
+
+                return;
+            }
+            long_queries += (strlen(queries[query].pattern) > QUERY_CACHE_KEY_SIZE);
+        }
+    }
+
+    if (
+        array->prefix_table == NULL
+        && (
+            array->cache->hits + array->cache->misses != (unsigned long long) CACHE_ROUNDS * query_count
+            || (large && array->cache->misses > (unsigned long long) (query_count + long_queries))
+        )
+    ) {
+        printf("FAILED: %s cache counted its hits and misses wrong on %s.\n", kind, name);
+        failure_count++;
+    }
+}
+
+// Answer a batch of the queries, each repeated several times and shuffled,
+// on several threads sharing one cache. Queries with line breaks in them are
+// left out, since a batch reads one pattern per line.
+static void check_cached_batch(char* name, suffix_array* array, cache_query* queries, int query_count) {
+    int round;
+    int query;
+    int swap;
+    int answer;
+    int batched;
+    int* order;
+    FILE* stream;
+    unsigned long long state;
+    query_batch* batch;
+
+    check_count++;
+    if ((order = malloc(sizeof(int) * CACHE_ROUNDS * query_count)) == NULL || (stream = tmpfile()) == NULL) {
+        printf("FAILED: couldn't write a batch of queries for %s.\n", name);
+        failure_count++;
+        free(order);
+
+        return;
+    }
+
+    batched = 0;
+    for (round = 0; round < CACHE_ROUNDS; round++) {
+        for (query = 0; query < query_count; query++) {
+            if (strpbrk(queries[query].pattern, "\r\n") == NULL) {
+                order[batched++] = query;
+            }
+        }
+    }
+    state = input_count;
+    for (answer = batched - 1; answer > 0; answer--) {
+        swap = next_random(&state) % (answer + 1);
+        query = order[answer];
+        order[answer] = order[swap];
+        order[swap] = query;
+    }
+    for (answer = 0; answer < batched; answer++) {
+        fprintf(stream, "%s\n", queries[order[answer]].pattern);
+    }
+    rewind(stream);
+
+    batch = read_query_batch(stream);
+    fclose(stream);
+    if (
+        batch == NULL
+        || batch->query_count != batched
+        || run_query_batch(array, batch, CACHE_THREADS) == FLAG_FAILURE
+    ) {
+        printf("FAILED: couldn't answer a batch of queries for %s.\n", name);
+        failure_count++;
+    }
+    else {
+        for (answer = 0; answer < batched; answer++) {
+            if (!matches_query(&batch->results[answer], &queries[order[answer]])) {
+                printf("FAILED: cached batch answer %d is wrong on %s.\n", answer, name);
+                failure_count++;
+                break;
+            }
+        }
+    }
+    destroy_query_batch(batch);
+    free(order);
+}
+
+// Check query caches on a string. The random patterns are joined by one
+// pattern too long to cache, if the string is long enough to hold one.
+void check_query_caches(char* name, char* string) {
+    int query;
+    int query_count;
+    text_position length;
+    unsigned long long state;
+    cache_query queries[PATTERN_COUNT + 1];
+    suffix_array* tiny;
+    suffix_array* large;
+    suffix_array* prefixed;
+    suffix_array* batched;
+
+    length = strlen(string);
+    state = input_count;
+    for (query = 0; query < PATTERN_COUNT; query++) {
+        random_pattern(string, length, &state, queries[query].pattern);
+    }
+    query_count = PATTERN_COUNT;
+    if (length >= LONG_PATTERN_LENGTH) {
+        memcpy(queries[query_count].pattern, string + length - LONG_PATTERN_LENGTH, LONG_PATTERN_LENGTH);
+        queries[query_count].pattern[LONG_PATTERN_LENGTH] = '\0';
+        query_count++;
+    }
+    for (query = 0; query < query_count; query++) {
+        queries[query].count = brute_occurrences(string, length, queries[query].pattern, &queries[query].below, NULL);
+    }
+
+    // The tiny cache holds a single set, so the queries keep evicting each
+    // other.
+    tiny = new_suffix_array_using(string, SORT_INDUCED, 1);
+    large = new_suffix_array_using(string, SORT_INDUCED, 1);
+    prefixed = new_suffix_array_using(string, SORT_INDUCED, 1);
+    batched = new_suffix_array_using(string, SORT_INDUCED, 1);
+    if (
+        tiny == NULL || large == NULL || prefixed == NULL || batched == NULL
+        || build_query_cache(tiny, 1) == FLAG_FAILURE
+        || build_query_cache(large, 64 * query_count) == FLAG_FAILURE
+        || build_prefix_table(prefixed, 1) == FLAG_FAILURE
+        || build_query_cache(prefixed, 64 * query_count) == FLAG_FAILURE
+        || build_lcp_array(batched) == FLAG_FAILURE
+        || build_query_cache(batched, 1) == FLAG_FAILURE
+    ) {
+        printf("FAILED: couldn't build suffix arrays with query caches of %s.\n", name);
+        failure_count++;
+    }
+    else {
+        check_cached_searches(name, "tiny cache", tiny, queries, query_count);
+        check_cached_searches(name, "large cache", large, queries, query_count);
+        check_cached_searches(name, "prefix table and cache", prefixed, queries, query_count);
+        check_cached_batch(name, batched, queries, query_count);
+    }
+    destroy_suffix_array(tiny);
+    destroy_suffix_array(large);
+    destroy_suffix_array(prefixed);
+    destroy_suffix_array(batched);
+}
@@ -0,0 +1,309 @@
+// Cross-checks every sorting method against the others. Each input is sorted
+// with the induced sort, which is checked to really be in order, and then
+// with every other method and, for parallel sorting, several thread counts.
+// All of them must produce byte-identical suffixes. Inputs that aren't too
+// long are then searched, and the answers checked against brute force. Inputs
+// come from the files named on the command line, read both as letters and as
+// raw bytes, plus generated edge cases.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cross_check.h"
+
+#define QUADRATIC_LIMIT 20000
+#define BRUTE_FORCE_LIMIT 10000
+#define RANDOM_INPUTS 200
+#define RANDOM_MAX_LENGTH 2000
+#define LONG_RUN_LENGTH 100000
+
+static const char* method_names[] = {"induced", "radix", "counting", "parallel"};
+
+int input_count;
+int check_count;
+int failure_count;
+
+// Generate the next number from a seeded xorshift generator, so every run
+// checks the same inputs.
+unsigned long long next_random(unsigned long long* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 2685821657736338717ULL;
+}
+
+// Pick a random pattern to search a string for. Most patterns are substrings
+// of the string, some of which run off its end, and the rest have one
+// character changed to another from the string or to any byte at all, so
+// they often don't appear.
+void random_pattern(char* string, text_position length, unsigned long long* state, char* pattern) {
+    text_position start;
+    text_position pattern_length;
+
+    start = next_random(state) % length;
+    pattern_length = 1 + next_random(state) % PATTERN_MAX_LENGTH;
+    if (pattern_length > length - start) {
+        pattern_length = length - start;
+    }
+    memcpy(pattern, string + start, pattern_length);
+    pattern[pattern_length] = '\0';
+
+    switch (next_random(state) % 4) {
+        case 2:
+            pattern[next_random(state) % pattern_length] = string[next_random(state) % length];
+            break;
+
+        case 3:
+            pattern[next_random(state) % pattern_length] = (char) (1 + next_random(state) % 255);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Check whether a string uses every byte but the null terminator, which
+// leaves no separator for a collection of documents cut from it.
+int uses_every_byte(char* string) {
+    int byte;
+    unsigned char present[ALPHABET_SIZE] = {0};
+
+    for (; *string != '\0'; string++) {
+        present[(unsigned char) *string] = 1;
+    }
+    for (byte = 1; byte < ALPHABET_SIZE && present[byte]; byte++);
+
+    return byte == ALPHABET_SIZE;
+}
+
+// Check that the suffixes of an array are a permutation of the positions of
+// its string, in strictly increasing order. A suffix that is a prefix of
+// another sorts first.
+static int is_sorted(suffix_array* array) {
+    text_position index;
+    text_position first;
+    text_position second;
+    text_position shorter;
+    int comparison;
+    unsigned char* seen;
+
+    if ((seen = calloc(array->string_length, sizeof(unsigned char))) == NULL) {
+        return 0;
+    }
+    for (index = 0; index < array->string_length; index++) {
+        first = array->suffixes[index];
+        if (first < 0 || first >= array->string_length || seen[first]) {
+            free(seen);
+
+            return 0;
+        }
+        seen[first] = 1;
+        if (index == 0) {
+            continue;
+        }
+
+        // The later suffix is the shorter one if it starts further along.
+        second = array->suffixes[index - 1];
+        shorter = array->string_length - ((first > second) ? first : second);
+        comparison = memcmp(array->string + second, array->string + first, shorter);
+        if (comparison > 0 || (comparison == 0 && second < first)) {
+            free(seen);
+
+            return 0;
+        }
+    }
+    free(seen);
+
+    return 1;
+}
+
+// Sort a string with one method and thread count, and compare its suffixes
+// with those of the reference array.
+static void check_method(char* name, char* string, suffix_array* reference, sort_method method, int threads) {
+    suffix_array* array;
+
+    check_count++;
+    array = new_suffix_array_using(string, method, threads);
+    if (
+        array == NULL
+        || array->string_length != reference->string_length
+        || memcmp(array->suffixes, reference->suffixes, sizeof(text_position) * reference->string_length) != 0
+    ) {
+        printf("FAILED: %s sorting with %d thread(s) differs on %s.\n", method_names[method], threads, name);
+        failure_count++;
+    }
+    destroy_suffix_array(array);
+}
+
+// Check every sorting method on a string, an external build of it, and then
+// its searches. The radix sorts are quadratic, so they're skipped on long
+// strings, as are the brute-force checks of the searches.
+static void check_string(char* name, char* string) {
+    int thread;
+    size_t length;
+    suffix_array* reference;
+    int thread_counts[] = {1, 2, 3, 4, 0};
+
+    input_count++;
+    check_count++;
+    if ((reference = new_suffix_array_using(string, SORT_INDUCED, 1)) == NULL || !is_sorted(reference)) {
+        printf("FAILED: induced sorting is out of order on %s.\n", name);
+        failure_count++;
+        destroy_suffix_array(reference);
+
+        return;
+    }
+
+    length = strlen(string);
+    if (length <= QUADRATIC_LIMIT) {
+        check_method(name, string, reference, SORT_RADIX, 1);
+        check_method(name, string, reference, SORT_COUNTING, 1);
+    }
+    thread_counts[4] = default_thread_count();
+    for (thread = 0; thread < (int) (sizeof(thread_counts) / sizeof(int)); thread++) {
+        check_method(name, string, reference, SORT_PARALLEL, thread_counts[thread]);
+    }
+    check_external_build(name, string, reference);
+    destroy_suffix_array(reference);
+
+    if (length <= BRUTE_FORCE_LIMIT) {
+        check_searches(name, string);
+        check_fm_indexes(name, string);
+        check_approximate_searches(name, string);
+        check_repeat_analyses(name, string);
+        check_query_caches(name, string);
+        check_documents(name, string);
+        check_appendable_indexes(name, string);
+    }
+}
+
+// Check a file, once with only its letters kept, as the driver does by
+// default, and once with every byte kept, as with --bytes.
+static void check_file(char* file_name) {
+    int keep_all;
+    long size;
+    char* raw;
+    char* string;
+    char name[1024];
+    FILE* file;
+
+    if ((file = fopen(file_name, "rb")) == NULL) {
+        printf("FAILED: couldn't read %s.\n", file_name);
+        failure_count++;
+
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    rewind(file);
+    raw = malloc(sizeof(char) * (size + 1));
+    string = malloc(sizeof(char) * (size + 1));
+    if (raw == NULL || string == NULL || fread(raw, sizeof(char), size, file) != (size_t) size) {
+        printf("FAILED: couldn't read %s.\n", file_name);
+        failure_count++;
+        free(raw);
+        free(string);
+        fclose(file);
+
+        return;
+    }
+    fclose(file);
+
+    for (keep_all = 0; keep_all <= 1; keep_all++) {
+        string[filter_characters(raw, size, string, keep_all)] = '\0';
+        if (string[0] != '\0') {
+            snprintf(name, sizeof(name), "%s%s", file_name, keep_all ? " (bytes)" : "");
+            check_string(name, string);
+        }
+    }
+    free(raw);
+    free(string);
+}
+
+// Check strings built to stress the sorts: single characters, binary bytes,
+// long runs of one character that leave one huge tied group for the parallel
+// sort to split across threads, periodic strings, and random strings over
+// small alphabets.
+static void check_generated(void) {
+    int input;
+    int symbols;
+    size_t length;
+    size_t position;
+    char* string;
+    char name[128];
+    unsigned long long state;
+
+    if ((string = malloc(sizeof(char) * (2 * LONG_RUN_LENGTH + 2))) == NULL) {
+        printf("FAILED: out of memory.\n");
+        failure_count++;
+
+        return;
+    }
+
+    check_string("a single letter", "a");
+    check_string("a single high byte", "\xff");
+    check_string("two equal letters", "aa");
+
+    // Every byte but the null terminator, twice over, highest first.
+    for (position = 0; position < 510; position++) {
+        string[position] = (char) (255 - position % 255);
+    }
+    string[510] = '\0';
+    check_string("every byte", string);
+
+    for (length = 1000; length <= LONG_RUN_LENGTH; length *= 10) {
+        memset(string, 'a', length);
+        string[length] = '\0';
+        snprintf(name, sizeof(name), "a run of %zu letters", length);
+        check_string(name, string);
+
+        string[length] = 'b';
+        memset(string + length + 1, 'a', length);
+        string[2 * length + 1] = '\0';
+        snprintf(name, sizeof(name), "two runs of %zu letters", length);
+        check_string(name, string);
+
+        for (position = 0; position < length; position++) {
+            string[position] = "abracadabra"[position % 11];
+        }
+        string[length] = '\0';
+        snprintf(name, sizeof(name), "%zu letters of a repeated word", length);
+        check_string(name, string);
+    }
+
+    state = 1;
+    for (input = 0; input < RANDOM_INPUTS; input++) {
+        length = 1 + next_random(&state) % RANDOM_MAX_LENGTH;
+        symbols = 1 + next_random(&state) % ((input % 2 == 0) ? 4 : 255);
+        for (position = 0; position < length; position++) {
+            string[position] = (char) (1 + next_random(&state) % symbols);
+        }
+        string[length] = '\0';
+        snprintf(name, sizeof(name), "random input %d (%zu bytes over %d symbols)", input, length, symbols);
+        check_string(name, string);
+    }
+    free(string);
+}
+
+// Main entry point of the cross-check. Every argument names a file to check.
+int main(int argument_count, char** arguments) {
+    int argument;
+
+    for (argument = 1; argument < argument_count; argument++) {
+        check_file(arguments[argument]);
+    }
+    check_generated();
+
+    printf(
+        "Checked %d inputs with %d checks (%d-byte positions): %d failure%s.\n",
+        input_count,
+        check_count,
+        (int) sizeof(text_position),
+        failure_count,
+        (failure_count == 1) ? "" : "s"
+    );
+
+    return (failure_count == 0) ? 0 : -1;
+}
@@ -0,0 +1,62 @@
+// Header file for the cross-checks, which compare the suffix array library
+// against brute-force answers.
+// Written by Tiger Sachse.
+
+#include "../source/suffix_array.h"
+
+#define PATTERN_COUNT 20
+#define PATTERN_MAX_LENGTH 12
+
+// A result found by brute force, of some length. A match between two strings
+// starts at first in one and second in the other, while a repeat starts at
+// first and appears second times.
+typedef struct brute_match {
+    text_position first;
+    text_position second;
+    text_position length;
+} brute_match;
+
+// The number of inputs checked, comparisons made, and comparisons failed.
+extern int input_count;
+extern int check_count;
+extern int failure_count;
+
+// Functional prototypes for the cross-check.
+unsigned long long next_random(unsigned long long*);
+void random_pattern(char*, text_position, unsigned long long*, char*);
+int uses_every_byte(char*);
+
+// Functional prototypes for brute-force answers.
+int compare_suffix(char*, text_position, text_position, char*, text_position);
+text_position brute_occurrences(char*, text_position, char*, text_position*, text_position*);
+text_position brute_common_prefix(char*, text_position, text_position, text_position);
+void sort_positions(text_position*, text_position);
+text_position brute_approximate(char*, text_position, char*, int, distance_measure, approximate_hit*);
+text_position brute_longest_repeat(char*, text_position);
+text_position brute_maximal_repeats(char*, text_position, text_position, brute_match**);
+text_position brute_longest_common_substring(char*, text_position, char*, text_position);
+text_position brute_maximal_unique_matches(char*, text_position, char*, text_position, text_position, brute_match**);
+
+// Functional prototypes for search checks.
+void check_searches(char*, char*);
+
+// Functional prototypes for FM-index checks.
+void check_fm_indexes(char*, char*);
+
+// Functional prototypes for approximate search checks.
+void check_approximate_searches(char*, char*);
+
+// Functional prototypes for repeat analysis checks.
+void check_repeat_analyses(char*, char*);
+
+// Functional prototypes for query cache checks.
+void check_query_caches(char*, char*);
+
+// Functional prototypes for document collection checks.
+void check_documents(char*, char*);
+
+// Functional prototypes for appendable index checks.
+void check_appendable_indexes(char*, char*);
+
+// Functional prototypes for external build checks.
+void check_external_build(char*, char*, suffix_array*);
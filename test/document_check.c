@@ -0,0 +1,267 @@
+// Cross-checks document collections against brute force. Every input is cut
+// into a few documents at random, some of them empty, and each search of the
+// collection must find the same hits as a scan of every document alone.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cross_check.h"
+
+#define MAX_DOCUMENTS 5
+
+// Compare two hits by their documents, then by their offsets.
+static int compare_hits(const void* first, const void* second) {
+    const document_hit* left;
+    const document_hit* right;
+
+    left = (const document_hit*) first;
+    right = (const document_hit*) second;
+    if (left->document != right->document) {
+        return (left->document > right->document) - (left->document < right->document);
+    }
+
+    return (left->offset > right->offset) - (left->offset < right->offset);
+}
+
+// Check where every document of a collection starts, and that every position
+// of the joined string belongs to the right document.
+static void check_starts(char* name, document_collection* collection, char** documents) {
+    int document;
+    text_position start;
+    text_position position;
+
+    check_count++;
+    start = 0;
+    for (document = 0; document <= collection->document_count; document++) {
+        if (collection->starts[document] != start) {
+            printf("FAILED: document %d of %s starts in the wrong place.\n", document, name);
+            failure_count++;
+
+            return;
+        }
+        if (document < collection->document_count) {
+            for (position = start; position <= start + (text_position) strlen(documents[document]); position++) {
+                if (position < collection->array->string_length && document_of(collection, position) != document) {
+                    printf(
+                        "FAILED: position " TEXT_POSITION_FORMAT " of %s is in the wrong document.\n",
+                        position,
+                        name
+                    );
+                    failure_count++;
+
+                    return;
+                }
+            }
+            start += strlen(documents[document]) + 1;
+        }
+    }
+}
+
+// Check the hits and the documents listed for a pattern against brute-force
+// scans of every document. Patterns holding the separator must be refused.
+static void check_document_search(
+    char* name,
+    document_collection* collection,
+    char** documents,
+    char* pattern,
+    int pattern_index,
+    document_hit* found,
+    document_hit* expected,
+    text_position* positions
+) {
+    int document;
+    int listed;
+    int expected_listed;
+    int* listings;
+    text_position count;
+    text_position visited;
+    text_position position;
+    text_position occurrences;
+    suffix_range range;
+    document_hit hit;
+
+    check_count++;
+    if (strchr(pattern, collection->separator) != NULL) {
+        if (document_search_range(collection, pattern, &range) != FLAG_FAILURE) {
+            printf("FAILED: pattern %d holds the separator but was searched on %s.\n", pattern_index, name);
+            failure_count++;
+        }
+
+        return;
+    }
+    if ((listings = malloc(sizeof(int) * collection->document_count)) == NULL) {
+        printf("FAILED: out of memory.\n");
+        failure_count++;
+
+        return;
+    }
+
+    count = 0;
+    expected_listed = 0;
+    for (document = 0; document < collection->document_count; document++) {
+        occurrences = brute_occurrences(documents[document], strlen(documents[document]), pattern, NULL, positions);
+        for (position = 0; position < occurrences; position++) {
+            expected[count].document = document;
+            expected[count].offset = positions[position];
+            count++;
+        }
+        expected_listed += (occurrences > 0);
+    }
+
+    if (
+        document_search_range(collection, pattern, &range) == FLAG_FAILURE
+        || range.high - range.low != count
+        || (listed = list_documents(collection, &range, listings)) != expected_listed
+    ) {
+        printf("FAILED: documents search for pattern %d is wrong on %s.\n", pattern_index, name);
+        failure_count++;
+        free(listings);
+
+        return;
+    }
+
+    // The listed documents come out in increasing order, one for each
+    // document with a hit.
+    for (document = 0; document < listed; document++) {
+        if (
+            (document > 0 && listings[document] <= listings[document - 1])
+            || brute_occurrences(
+                documents[listings[document]],
+                strlen(documents[listings[document]]),
+                pattern,
+                NULL,
+                NULL
+            ) == 0
+        ) {
+            printf("FAILED: documents listed for pattern %d are wrong on %s.\n", pattern_index, name);
+            failure_count++;
+            free(listings);
+
+            return;
+        }
+    }
+    free(listings);
+
+    visited = 0;
+    while (visited < count && next_document_hit(collection, &range, &hit) != FLAG_FAILURE) {
+        found[visited++] = hit;
+    }
+    if (visited > 1) {
+        qsort(found, visited, sizeof(document_hit), compare_hits);
+    }
+    if (visited != count || next_document_hit(collection, &range, &hit) != FLAG_FAILURE) {
+        printf("FAILED: document hits for pattern %d are wrong on %s.\n", pattern_index, name);
+        failure_count++;
+
+        return;
+    }
+    for (position = 0; position < count; position++) {
+        if (compare_hits(&found[position], &expected[position]) != 0) {
+            printf("FAILED: document hits for pattern %d are wrong on %s.\n", pattern_index, name);
+            failure_count++;
+
+            return;
+        }
+    }
+}
+
+// Check a collection of documents cut from a string. The number of documents
+// changes from input to input, and so do the cuts, which may leave some
+// documents empty. Odd inputs are searched with LCP tables and bit packing.
+void check_documents(char* name, char* string) {
+    int slot;
+    int document;
+    int pattern_index;
+    int document_count;
+    text_position length;
+    text_position cut;
+    text_position cuts[MAX_DOCUMENTS + 1];
+    text_position* positions;
+    char* documents[MAX_DOCUMENTS];
+    char pattern[PATTERN_MAX_LENGTH + 1];
+    unsigned long long state;
+    document_hit* found;
+    document_hit* expected;
+    document_collection* collection;
+
+    length = strlen(string);
+    state = input_count;
+    document_count = 1 + input_count % MAX_DOCUMENTS;
+
+    // Choose the cuts and keep them in order, so the documents cover the
+    // string from start to end.
+    cuts[0] = 0;
+    cuts[document_count] = length;
+    for (document = 1; document < document_count; document++) {
+        cut = next_random(&state) % (length + 1);
+        for (slot = document; slot > 1 && cuts[slot - 1] > cut; slot--) {
+            cuts[slot] = cuts[slot - 1];
+        }
+        cuts[slot] = cut;
+    }
+
+    positions = malloc(sizeof(text_position) * (length + 1));
+    found = malloc(sizeof(document_hit) * (length + 1));
+    expected = malloc(sizeof(document_hit) * (length + 1));
+    for (document = 0; document < document_count; document++) {
+        if ((documents[document] = malloc(sizeof(char) * (cuts[document + 1] - cuts[document] + 1))) != NULL) {
+            memcpy(documents[document], string + cuts[document], cuts[document + 1] - cuts[document]);
+            documents[document][cuts[document + 1] - cuts[document]] = '\0';
+        }
+    }
+    for (document = 0; document < document_count && documents[document] != NULL; document++);
+    if (positions == NULL || found == NULL || expected == NULL || document < document_count) {
+        printf("FAILED: out of memory.\n");
+        failure_count++;
+    }
+
+    // A collection needs a byte that no document uses.
+    else if ((collection = new_document_collection(documents, document_count, SORT_INDUCED, 1)) == NULL) {
+        if (!uses_every_byte(string)) {
+            printf("FAILED: couldn't build a collection of %d documents of %s.\n", document_count, name);
+            failure_count++;
+        }
+    }
+    else {
+        check_count++;
+        if (
+            input_count % 2 == 1
+            && (
+                build_lcp_array(collection->array) == FLAG_FAILURE
+                || bit_pack_suffixes(collection->array) == FLAG_FAILURE
+            )
+        ) {
+            printf("FAILED: couldn't build tables for a collection of %s.\n", name);
+            failure_count++;
+        }
+        check_starts(name, collection, documents);
+
+        // The last pattern ends with the separator, which the collection
+        // must refuse to search for.
+        for (pattern_index = 0; pattern_index <= PATTERN_COUNT; pattern_index++) {
+            random_pattern(string, length, &state, pattern);
+            if (pattern_index == PATTERN_COUNT) {
+                pattern[strlen(pattern) - 1] = collection->separator;
+            }
+            check_document_search(
+                name,
+                collection,
+                documents,
+                pattern,
+                pattern_index,
+                found,
+                expected,
+                positions
+            );
+        }
+        destroy_document_collection(collection);
+    }
+
+    for (document = 0; document < document_count; document++) {
+        free(documents[document]);
+    }
+    free(positions);
+    free(found);
+    free(expected);
+}
@@ -0,0 +1,96 @@
+// Cross-checks external builds against induced sorting. Every input is written
+// to a text file and indexed with the smallest memory budget, so longer inputs
+// are sorted in several runs that have to be merged, and the index file must
+// load back with the same string and suffixes as the reference array.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cross_check.h"
+
+// Check whether every character of a string is alphabetic, so an external
+// build that keeps only letters must keep all of it.
+static int all_alphabetic(char* string) {
+
+    for (; *string != '\0'; string++) {
+        if (!is_alphabetic(*string)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Build an index file of a string externally and compare it with the
+// reference array. Strings of letters alone are built keeping only letters,
+// and any others keeping every byte, so neither filter may change them.
+void check_external_build(char* name, char* string, suffix_array* reference) {
+    int file;
+    int keep_all;
+    int matches;
+    size_t length;
+    text_position suffix_index;
+    char text_name[] = "/tmp/sufarray_check_XXXXXX";
+    char index_name[] = "/tmp/sufarray_check_XXXXXX";
+    FILE* text;
+    suffix_array* loaded;
+
+    check_count++;
+    if ((file = mkstemp(text_name)) < 0) {
+        printf("FAILED: couldn't create a text file for %s.\n", name);
+        failure_count++;
+
+        return;
+    }
+    close(file);
+    if ((file = mkstemp(index_name)) < 0) {
+        printf("FAILED: couldn't create an index file for %s.\n", name);
+        failure_count++;
+        remove(text_name);
+
+        return;
+    }
+    close(file);
+
+    length = strlen(string);
+    if ((text = fopen(text_name, "wb")) == NULL || fwrite(string, sizeof(char), length, text) != length) {
+        printf("FAILED: couldn't write a text file for %s.\n", name);
+        failure_count++;
+        if (text != NULL) {
+            fclose(text);
+        }
+        remove(text_name);
+        remove(index_name);
+
+        return;
+    }
+    fclose(text);
+
+    keep_all = !all_alphabetic(string);
+    loaded = NULL;
+    if (
+        build_external_index(text_name, index_name, keep_all, EXTERNAL_MIN_MEMORY, NULL) == FLAG_FAILURE
+        || (loaded = load_suffix_array(index_name)) == NULL
+    ) {
+        printf("FAILED: couldn't build an index file externally for %s.\n", name);
+        failure_count++;
+    }
+    else {
+        matches = (
+            loaded->string_length == reference->string_length
+            && memcmp(loaded->string, reference->string, length) == 0
+        );
+        for (suffix_index = 0; matches && suffix_index < reference->string_length; suffix_index++) {
+            matches = (suffix_at(loaded, suffix_index) == suffix_at(reference, suffix_index));
+        }
+        if (!matches) {
+            printf("FAILED: external build differs on %s.\n", name);
+            failure_count++;
+        }
+    }
+    destroy_suffix_array(loaded);
+    remove(text_name);
+    remove(index_name);
+}
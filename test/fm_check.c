@@ -0,0 +1,150 @@
+// Cross-checks FM-indexes against brute force. Every input is indexed with
+// several sample rates, and each index must locate every sorted suffix and
+// answer random searches exactly like a scan of the whole string.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cross_check.h"
+
+#define SAMPLE_RATE_COUNT 3
+
+// Check that an FM-index locates every sorted suffix of the suffix array it
+// was built from.
+static void check_locate(char* name, suffix_array* array, fm_index* index) {
+    text_position suffix_index;
+
+    check_count++;
+    for (suffix_index = 0; suffix_index < array->string_length; suffix_index++) {
+        if (fm_locate(index, suffix_index) != suffix_at(array, suffix_index)) {
+            printf(
+                "FAILED: FM-index with sample rate " TEXT_POSITION_FORMAT " mislocates suffix "
+                TEXT_POSITION_FORMAT " of %s.\n",
+                index->sample_rate,
+                suffix_index,
+                name
+            );
+            failure_count++;
+
+            return;
+        }
+    }
+}
+
+// Report a wrong search of an FM-index for a pattern.
+static void report_fm_search(char* name, fm_index* index, int pattern_index) {
+
+    printf(
+        "FAILED: FM-index with sample rate " TEXT_POSITION_FORMAT " is wrong for pattern %d on %s.\n",
+        index->sample_rate,
+        pattern_index,
+        name
+    );
+    failure_count++;
+}
+
+// Check the searches of an FM-index for a pattern against its brute-force
+// occurrences, of which there are count, with below suffixes sorting lower.
+// Every occurrence it locates is saved in found.
+static void check_fm_search(
+    char* name,
+    fm_index* index,
+    char* pattern,
+    int pattern_index,
+    text_position count,
+    text_position below,
+    text_position* positions,
+    text_position* found
+) {
+    text_position visited;
+    text_position position;
+    suffix_range range;
+
+    if (
+        fm_count_occurrences(index, pattern) != count
+        || fm_search_range(index, pattern, &range) == FLAG_FAILURE
+        || range.high - range.low != count
+        || (count > 0 && range.low != below)
+    ) {
+        report_fm_search(name, index, pattern_index);
+
+        return;
+    }
+
+    visited = 0;
+    while (visited < count && (position = fm_next_occurrence(index, &range)) != FLAG_FAILURE) {
+        found[visited++] = position;
+    }
+    sort_positions(found, visited);
+    if (
+        visited != count
+        || fm_next_occurrence(index, &range) != FLAG_FAILURE
+        || memcmp(found, positions, sizeof(text_position) * count) != 0
+    ) {
+        report_fm_search(name, index, pattern_index);
+    }
+}
+
+// Check FM-indexes of a string with several sample rates.
+void check_fm_indexes(char* name, char* string) {
+    int rate;
+    int pattern_index;
+    text_position count;
+    text_position below;
+    text_position length;
+    text_position* found;
+    text_position* positions;
+    char pattern[PATTERN_MAX_LENGTH + 1];
+    unsigned long long state;
+    suffix_array* array;
+    fm_index* indexes[SAMPLE_RATE_COUNT];
+    text_position sample_rates[SAMPLE_RATE_COUNT] = {1, 3, FM_SAMPLE_RATE};
+
+    length = strlen(string);
+    array = new_suffix_array_using(string, SORT_INDUCED, 1);
+    found = malloc(sizeof(text_position) * length);
+    positions = malloc(sizeof(text_position) * length);
+    if (array == NULL || found == NULL || positions == NULL) {
+        printf("FAILED: out of memory.\n");
+        failure_count++;
+        destroy_suffix_array(array);
+        free(found);
+        free(positions);
+
+        return;
+    }
+
+    for (rate = 0; rate < SAMPLE_RATE_COUNT; rate++) {
+        check_count++;
+        if ((indexes[rate] = new_fm_index(array, sample_rates[rate])) == NULL) {
+            printf(
+                "FAILED: couldn't build an FM-index with sample rate " TEXT_POSITION_FORMAT " of %s.\n",
+                sample_rates[rate],
+                name
+            );
+            failure_count++;
+        }
+        else {
+            check_locate(name, array, indexes[rate]);
+        }
+    }
+
+    state = input_count;
+    for (pattern_index = 0; pattern_index < PATTERN_COUNT; pattern_index++) {
+        random_pattern(string, length, &state, pattern);
+        count = brute_occurrences(string, length, pattern, &below, positions);
+        for (rate = 0; rate < SAMPLE_RATE_COUNT; rate++) {
+            if (indexes[rate] != NULL) {
+                check_fm_search(name, indexes[rate], pattern, pattern_index, count, below, positions, found);
+            }
+        }
+    }
+
+    for (rate = 0; rate < SAMPLE_RATE_COUNT; rate++) {
+        destroy_fm_index(indexes[rate]);
+    }
+    destroy_suffix_array(array);
+    free(found);
+    free(positions);
+}
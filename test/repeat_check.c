@@ -0,0 +1,279 @@
+// Cross-checks repeat analyses against brute force. Every input is checked
+// for its longest repeat and its maximal repeats, and is then split in two to
+// check the longest common substring and maximal unique matches of the
+// halves.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cross_check.h"
+
+// The string whose repeats are being sorted.
+static char* sorted_string;
+
+// Compare two repeats of the sorted string by length, then by their
+// characters, then by the number of times they appear.
+static int compare_repeats(const void* first, const void* second) {
+    int comparison;
+    const brute_match* left;
+    const brute_match* right;
+
+    left = (const brute_match*) first;
+    right = (const brute_match*) second;
+    if (left->length != right->length) {
+        return (left->length > right->length) - (left->length < right->length);
+    }
+    comparison = memcmp(sorted_string + left->first, sorted_string + right->first, left->length);
+    if (comparison != 0) {
+        return comparison;
+    }
+
+    return (left->second > right->second) - (left->second < right->second);
+}
+
+// Compare two matches by their positions, then by their lengths.
+static int compare_matches(const void* first, const void* second) {
+    const brute_match* left;
+    const brute_match* right;
+
+    left = (const brute_match*) first;
+    right = (const brute_match*) second;
+    if (left->first != right->first) {
+        return (left->first > right->first) - (left->first < right->first);
+    }
+    if (left->second != right->second) {
+        return (left->second > right->second) - (left->second < right->second);
+    }
+
+    return (left->length > right->length) - (left->length < right->length);
+}
+
+// Read back the results that an analysis wrote to a stream, three numbers a
+// line, into a new list, which the caller must free. Repeats are written as
+// their length, the number of times they appear, and a position, and matches
+// as their two positions and their length. Returns the number of results.
+static text_position read_results(FILE* stream, int repeats, brute_match** results) {
+    text_position count;
+    text_position capacity;
+    text_position values[3];
+    brute_match* resized;
+
+    *results = NULL;
+    count = 0;
+    capacity = 0;
+    rewind(stream);
+    while (
+        fscanf(
+            stream,
+            TEXT_POSITION_FORMAT TEXT_POSITION_FORMAT TEXT_POSITION_FORMAT,
+            &values[0],
+            &values[1],
+            &values[2]
+        ) == 3
+    ) {
+        if (count == capacity) {
+            capacity = 2 * capacity + 16;
+            if ((resized = realloc(*results, sizeof(brute_match) * capacity)) == NULL) {
+                return FLAG_FAILURE;
+            }
+            *results = resized;
+        }
+        (*results)[count].first = repeats ? values[2] : values[0];
+        (*results)[count].second = values[1];
+        (*results)[count].length = repeats ? values[0] : values[2];
+        count++;
+    }
+
+    return count;
+}
+
+// Check that two lists of results hold the same results, in any order.
+static int same_results(
+    brute_match* found,
+    text_position found_count,
+    brute_match* expected,
+    text_position expected_count,
+    int (*compare)(const void*, const void*)
+) {
+    text_position result;
+
+    if (found_count != expected_count || found_count == FLAG_FAILURE) {
+        return 0;
+    }
+    if (found_count > 1) {
+        qsort(found, found_count, sizeof(brute_match), compare);
+        qsort(expected, expected_count, sizeof(brute_match), compare);
+    }
+    for (result = 0; result < found_count; result++) {
+        if (compare(&found[result], &expected[result]) != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Check the longest repeat and the maximal repeats of a suffix array.
+static void check_repeats(char* name, suffix_array* array, text_position min_length) {
+    FILE* stream;
+    text_position first;
+    text_position second;
+    text_position length;
+    text_position written;
+    text_position found_count;
+    text_position expected_count;
+    brute_match* found;
+    brute_match* expected;
+
+    check_count++;
+    if (
+        longest_repeat(array, &first, &second, &length) == FLAG_FAILURE
+        || length != brute_longest_repeat(array->string, array->string_length)
+        || (
+            length > 0
+            && (
+                first == second
+                || first + length > array->string_length
+                || second + length > array->string_length
+                || memcmp(array->string + first, array->string + second, length) != 0
+            )
+        )
+    ) {
+        printf("FAILED: the longest repeat of %s is wrong.\n", name);
+        failure_count++;
+    }
+
+    check_count++;
+    if ((stream = tmpfile()) == NULL) {
+        printf("FAILED: couldn't create a temporary file for %s.\n", name);
+        failure_count++;
+
+        return;
+    }
+    written = print_maximal_repeats(array, min_length, stream);
+    found_count = read_results(stream, 1, &found);
+    expected_count = brute_maximal_repeats(array->string, array->string_length, min_length, &expected);
+    sorted_string = array->string;
+    if (written != found_count || !same_results(found, found_count, expected, expected_count, compare_repeats)) {
+        printf(
+            "FAILED: the maximal repeats of at least " TEXT_POSITION_FORMAT " characters of %s are wrong.\n",
+            min_length,
+            name
+        );
+        failure_count++;
+    }
+    fclose(stream);
+    free(found);
+    free(expected);
+}
+
+// Check the longest common substring and the maximal unique matches of a
+// collection of two documents.
+static void check_matches(char* name, document_collection* collection, char** documents, text_position min_length) {
+    FILE* stream;
+    text_position first;
+    text_position second;
+    text_position length;
+    text_position written;
+    text_position found_count;
+    text_position expected_count;
+    text_position lengths[2];
+    brute_match* found;
+    brute_match* expected;
+
+    lengths[0] = strlen(documents[0]);
+    lengths[1] = strlen(documents[1]);
+    check_count++;
+    if (
+        longest_common_substring(collection, &first, &second, &length) == FLAG_FAILURE
+        || length != brute_longest_common_substring(documents[0], lengths[0], documents[1], lengths[1])
+        || (
+            length > 0
+            && (
+                first + length > lengths[0]
+                || second + length > lengths[1]
+                || memcmp(documents[0] + first, documents[1] + second, length) != 0
+            )
+        )
+    ) {
+        printf("FAILED: the longest common substring of the halves of %s is wrong.\n", name);
+        failure_count++;
+    }
+
+    check_count++;
+    if ((stream = tmpfile()) == NULL) {
+        printf("FAILED: couldn't create a temporary file for %s.\n", name);
+        failure_count++;
+
+        return;
+    }
+    written = print_maximal_unique_matches(collection, min_length, stream);
+    found_count = read_results(stream, 0, &found);
+    expected_count = brute_maximal_unique_matches(
+        documents[0],
+        lengths[0],
+        documents[1],
+        lengths[1],
+        min_length,
+        &expected
+    );
+    if (written != found_count || !same_results(found, found_count, expected, expected_count, compare_matches)) {
+        printf(
+            "FAILED: the maximal unique matches of at least " TEXT_POSITION_FORMAT
+            " characters between the halves of %s are wrong.\n",
+            min_length,
+            name
+        );
+        failure_count++;
+    }
+    fclose(stream);
+    free(found);
+    free(expected);
+}
+
+// Check every repeat analysis of a string. The shortest repeats and matches
+// listed change from input to input.
+void check_repeat_analyses(char* name, char* string) {
+    size_t length;
+    text_position min_length;
+    char* documents[2];
+    suffix_array* array;
+    document_collection* collection;
+
+    min_length = 1 + input_count % 3;
+    if ((array = new_suffix_array_using(string, SORT_INDUCED, 1)) == NULL) {
+        printf("FAILED: couldn't build a suffix array of %s for repeat analysis.\n", name);
+        failure_count++;
+
+        return;
+    }
+    check_repeats(name, array, min_length);
+    destroy_suffix_array(array);
+
+    length = strlen(string);
+    documents[0] = malloc(sizeof(char) * (length / 2 + 1));
+    documents[1] = strdup(string + length / 2);
+    if (documents[0] == NULL || documents[1] == NULL) {
+        printf("FAILED: out of memory.\n");
+        failure_count++;
+        free(documents[0]);
+        free(documents[1]);
+
+        return;
+    }
+    memcpy(documents[0], string, length / 2);
+    documents[0][length / 2] = '\0';
+
+    // A collection needs a byte that neither half uses.
+    if ((collection = new_document_collection(documents, 2, SORT_INDUCED, 1)) != NULL) {
+        check_matches(name, collection, documents, min_length);
+    }
+    else if (!uses_every_byte(string)) {
+        printf("FAILED: couldn't build a collection of the halves of %s.\n", name);
+        failure_count++;
+    }
+    destroy_document_collection(collection);
+    free(documents[0]);
+    free(documents[1]);
+}
@@ -0,0 +1,354 @@
+// Cross-checks searches against brute force. Every input is searched for the
+// same patterns with each search structure, and every answer must match a
+// scan of the whole string.
+// Written by Tiger Sachse.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cross_check.h"
+
+// How the suffixes of a suffix array are stored.
+typedef enum packing {
+    PACKING_NONE,
+    PACKING_BYTES,
+    PACKING_BITS
+} packing;
+
+// A search structure that is checked, as the options its suffix array is
+// built with. Loaded suffix arrays are saved to an index file and mapped back
+// in before they're searched. A prefix length or layout spacing below 0
+// builds no prefix table or search layout, and one of 0 picks the default.
+typedef struct search_configuration {
+    char* name;
+    int lcp;
+    packing packing;
+    int loaded;
+    int prefix_length;
+    text_position layout_spacing;
+} search_configuration;
+
+static const search_configuration configurations[] = {
+    {"plain", 0, PACKING_NONE, 0, -1, -1},
+    {"LCP", 1, PACKING_NONE, 0, -1, -1},
+    {"packed", 0, PACKING_BYTES, 0, -1, -1},
+    {"bit packed", 0, PACKING_BITS, 0, -1, -1},
+    {"loaded", 1, PACKING_NONE, 1, -1, -1},
+    {"loaded packed", 1, PACKING_BYTES, 1, -1, -1},
+    {"loaded bit packed", 0, PACKING_BITS, 1, -1, -1},
+    {"one-character prefix table", 0, PACKING_NONE, 0, 1, -1},
+    {"two-character prefix table", 1, PACKING_NONE, 0, 2, -1},
+    {"automatic prefix table", 0, PACKING_BITS, 0, 0, -1},
+    {"default layout", 0, PACKING_NONE, 0, -1, 0},
+    {"dense layout", 1, PACKING_BYTES, 0, -1, 1},
+    {"sparse layout", 0, PACKING_BITS, 0, -1, 5},
+    {"prefix table and layout", 1, PACKING_NONE, 0, 1, 3}
+};
+
+#define CONFIGURATION_COUNT ((int) (sizeof(configurations) / sizeof(search_configuration)))
+
+// Check that a loaded suffix array holds exactly what was saved.
+static int same_contents(suffix_array* saved, suffix_array* loaded) {
+    text_position index;
+
+    if (
+        saved->string_length != loaded->string_length
+        || saved->alphabet_size != loaded->alphabet_size
+        || saved->suffix_bits != loaded->suffix_bits
+        || (saved->packed_suffixes == NULL) != (loaded->packed_suffixes == NULL)
+        || (saved->lcp == NULL) != (loaded->lcp == NULL)
+        || memcmp(saved->string, loaded->string, saved->string_length) != 0
+        || memcmp(saved->symbols, loaded->symbols, sizeof(saved->symbols)) != 0
+    ) {
+        return 0;
+    }
+    for (index = 0; index < saved->string_length; index++) {
+        if (
+            suffix_at(saved, index) != suffix_at(loaded, index)
+            || (
+                saved->lcp != NULL
+                && (
+                    saved->lcp[index] != loaded->lcp[index]
+                    || saved->left_lcp[index] != loaded->left_lcp[index]
+                    || saved->right_lcp[index] != loaded->right_lcp[index]
+                )
+            )
+        ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Save a suffix array to a temporary index file and load it back, destroying
+// the original. The file must be refused while it's a byte short, and the
+// loaded suffixes may only be packed again if that changes nothing. Returns
+// the loaded suffix array, or NULL if it couldn't be saved or loaded.
+static suffix_array* save_and_load(char* name, suffix_array* array, const search_configuration* configuration) {
+    int file;
+    int can_pack;
+    int can_bit_pack;
+    char file_name[] = "/tmp/sufarray_check_XXXXXX";
+    struct stat status;
+    suffix_array* loaded;
+
+    if ((file = mkstemp(file_name)) < 0) {
+        destroy_suffix_array(array);
+
+        return NULL;
+    }
+    close(file);
+
+    if (
+        save_suffix_array(array, file_name) == FLAG_SUCCESS
+        && stat(file_name, &status) == 0
+        && truncate(file_name, status.st_size - 1) == 0
+        && (loaded = load_suffix_array(file_name)) != NULL
+    ) {
+        printf("FAILED: a truncated %s index file of %s was loaded.\n", configuration->name, name);
+        failure_count++;
+        destroy_suffix_array(loaded);
+    }
+    loaded = (save_suffix_array(array, file_name) == FLAG_SUCCESS) ? load_suffix_array(file_name) : NULL;
+    remove(file_name);
+    if (loaded == NULL) {
+        destroy_suffix_array(array);
+
+        return NULL;
+    }
+
+    if (!same_contents(array, loaded)) {
+        printf("FAILED: a %s index file of %s didn't load what was saved.\n", configuration->name, name);
+        failure_count++;
+    }
+    destroy_suffix_array(array);
+
+    can_pack = (loaded->packed_suffixes != NULL || sizeof(text_position) <= PACKED_SUFFIX_SIZE);
+    can_bit_pack = (loaded->suffix_bits != 0);
+    if (
+        (pack_suffixes(loaded) == FLAG_SUCCESS) != can_pack
+        || (bit_pack_suffixes(loaded) == FLAG_SUCCESS) != can_bit_pack
+    ) {
+        printf("FAILED: packing a %s index file of %s went wrong.\n", configuration->name, name);
+        failure_count++;
+    }
+
+    return loaded;
+}
+
+// Build a suffix array of a string with one search structure.
+static suffix_array* build_configuration(char* name, char* string, const search_configuration* configuration) {
+    suffix_array* array;
+
+    if ((array = new_suffix_array_using(string, SORT_INDUCED, 1)) == NULL) {
+        return NULL;
+    }
+
+    if (
+        (configuration->lcp && build_lcp_array(array) == FLAG_FAILURE)
+        || (configuration->packing == PACKING_BYTES && pack_suffixes(array) == FLAG_FAILURE)
+        || (configuration->packing == PACKING_BITS && bit_pack_suffixes(array) == FLAG_FAILURE)
+        || (
+            configuration->prefix_length >= 0
+            && build_prefix_table(array, configuration->prefix_length) == FLAG_FAILURE
+        )
+        || (
+            configuration->layout_spacing >= 0
+            && build_search_layout(array, configuration->layout_spacing) == FLAG_FAILURE
+        )
+    ) {
+        destroy_suffix_array(array);
+
+        return NULL;
+    }
+    if (configuration->loaded) {
+        return save_and_load(name, array, configuration);
+    }
+
+    return array;
+}
+
+// Check that entry i of the LCP array of a suffix array holds the length of
+// the common prefix of sorted suffixes i - 1 and i.
+static void check_lcp_array(char* name, suffix_array* array, const search_configuration* configuration) {
+    text_position rank;
+
+    check_count++;
+    for (rank = 0; rank < array->string_length; rank++) {
+        if (
+            array->lcp[rank] != ((rank == 0) ? 0 : brute_common_prefix(
+                array->string,
+                array->string_length,
+                suffix_at(array, rank - 1),
+                suffix_at(array, rank)
+            ))
+        ) {
+            printf(
+                "FAILED: %s LCP entry " TEXT_POSITION_FORMAT " is wrong on %s.\n",
+                configuration->name,
+                rank,
+                name
+            );
+            failure_count++;
+
+            return;
+        }
+    }
+}
+
+// Report a wrong search for a pattern. Patterns are named by number, since
+// they can hold any byte.
+static void report_search(char* name, char* kind, int pattern_index, const search_configuration* configuration) {
+
+    printf(
+        "FAILED: %s %s for pattern %d is wrong on %s.\n",
+        configuration->name,
+        kind,
+        pattern_index,
+        name
+    );
+    failure_count++;
+}
+
+// Check the searches of a suffix array for a pattern against its brute-force
+// occurrences, of which there are count, with below suffixes sorting lower.
+// An empty range may sit anywhere, since patterns with characters outside the
+// alphabet have no place among the suffixes. Every occurrence the iterator
+// visits is saved in found.
+static void check_search(
+    char* name,
+    suffix_array* array,
+    char* pattern,
+    int pattern_index,
+    text_position count,
+    text_position below,
+    text_position* positions,
+    text_position* found,
+    const search_configuration* configuration
+) {
+    char first[2];
+    text_position visited;
+    text_position position;
+    suffix_range range;
+    suffix_range narrowed;
+
+    position = search(array, pattern);
+    if (
+        (count == 0 && position != FLAG_FAILURE)
+        || (count > 0 && (position < 0 || compare_suffix(
+            array->string,
+            array->string_length,
+            position,
+            pattern,
+            strlen(pattern)
+        ) != 0))
+    ) {
+        report_search(name, "search", pattern_index, configuration);
+    }
+    if (count_occurrences(array, pattern) != count) {
+        report_search(name, "count", pattern_index, configuration);
+    }
+
+    if (
+        search_range(array, pattern, &range) == FLAG_FAILURE
+        || range.high - range.low != count
+        || (count > 0 && range.low != below)
+    ) {
+        report_search(name, "range search", pattern_index, configuration);
+
+        return;
+    }
+
+    // The iterator visits the range in sorted order, and must leave it empty.
+    visited = 0;
+    while (visited < count && (position = next_occurrence(array, &range)) != FLAG_FAILURE) {
+        found[visited++] = position;
+    }
+    sort_positions(found, visited);
+    if (
+        visited != count
+        || next_occurrence(array, &range) != FLAG_FAILURE
+        || memcmp(found, positions, sizeof(text_position) * count) != 0
+    ) {
+        report_search(name, "iterator", pattern_index, configuration);
+    }
+
+    // Narrowing the range of the first character down to the whole pattern
+    // must find the same range.
+    first[0] = pattern[0];
+    first[1] = '\0';
+    if (
+        search_range(array, first, &narrowed) == FLAG_FAILURE
+        || narrow_range(array, pattern, 1, &narrowed) == FLAG_FAILURE
+        || narrowed.high - narrowed.low != count
+        || (count > 0 && narrowed.low != below)
+    ) {
+        report_search(name, "narrowed range search", pattern_index, configuration);
+    }
+}
+
+// Check searches of a string for random patterns with every search
+// structure.
+void check_searches(char* name, char* string) {
+    int pattern_index;
+    text_position count;
+    text_position below;
+    text_position length;
+    text_position* found;
+    text_position* positions;
+    char pattern[PATTERN_MAX_LENGTH + 1];
+    int configuration;
+    unsigned long long state;
+    suffix_array* arrays[CONFIGURATION_COUNT];
+
+    for (configuration = 0; configuration < CONFIGURATION_COUNT; configuration++) {
+        check_count++;
+        arrays[configuration] = build_configuration(name, string, &configurations[configuration]);
+        if (arrays[configuration] == NULL) {
+            printf("FAILED: couldn't build a %s suffix array of %s.\n", configurations[configuration].name, name);
+            failure_count++;
+        }
+        else if (arrays[configuration]->lcp != NULL) {
+            check_lcp_array(name, arrays[configuration], &configurations[configuration]);
+        }
+    }
+
+    length = strlen(string);
+    found = malloc(sizeof(text_position) * length);
+    positions = malloc(sizeof(text_position) * length);
+    if (found == NULL || positions == NULL) {
+        printf("FAILED: out of memory.\n");
+        failure_count++;
+        length = 0;
+    }
+
+    state = input_count;
+    for (pattern_index = 0; length > 0 && pattern_index < PATTERN_COUNT; pattern_index++) {
+        random_pattern(string, length, &state, pattern);
+        count = brute_occurrences(string, length, pattern, &below, positions);
+        for (configuration = 0; configuration < CONFIGURATION_COUNT; configuration++) {
+            if (arrays[configuration] != NULL) {
+                check_search(
+                    name,
+                    arrays[configuration],
+                    pattern,
+                    pattern_index,
+                    count,
+                    below,
+                    positions,
+                    found,
+                    &configurations[configuration]
+                );
+            }
+        }
+    }
+
+    for (configuration = 0; configuration < CONFIGURATION_COUNT; configuration++) {
+        destroy_suffix_array(arrays[configuration]);
+    }
+    free(found);
+    free(positions);
+}